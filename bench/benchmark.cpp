@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "benchmark.h"
+
+using namespace eax;
+
+void BenchmarkRunner::run(std::string const& name, double itemsPerIteration,
+                          std::string const& itemName,
+                          std::function<double()> iteration) {
+  if (name.find(filter) == std::string::npos) return;
+  
+  // Warm up caches and lazily initialized state.
+  iteration();
+  
+  uint64_t iterations = 0;
+  double totalSeconds = 0;
+  double minSeconds = 0;
+  // Run at least a few iterations, so that the minimum means something.
+  while (totalSeconds < this->minSeconds || iterations < 3) {
+    double seconds = iteration();
+    minSeconds = iterations == 0 ? seconds : std::min(minSeconds, seconds);
+    totalSeconds += seconds;
+    ++iterations;
+  }
+  
+  results.push_back({name, iterations, totalSeconds / iterations, minSeconds,
+                     itemsPerIteration, itemName});
+  if (progressStream) printResult(*progressStream, results.back());
+}
+
+void BenchmarkRunner::printResult(std::ostream& out, Result const& result) const {
+  auto flags = out.flags();
+  out << std::left << std::setw(24) << result.name << std::right
+      << std::setw(10) << result.iterations << " iterations"
+      << std::scientific << std::setprecision(3)
+      << std::setw(12) << result.meanSeconds << " s mean"
+      << std::setw(12) << result.minSeconds << " s min";
+  if (result.itemsPerIteration > 0) {
+    out << std::setw(12) << result.itemsPerIteration / result.meanSeconds
+        << ' ' << result.itemName << "/s";
+  }
+  out << std::endl;
+  out.flags(flags);
+}
+
+void BenchmarkRunner::printJSON(std::ostream& out, std::string const& context) const {
+  auto flags = out.flags();
+  out << std::scientific << std::setprecision(6);
+  out << "{\"context\": " << context << ", \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto const& result = results[i];
+    if (i > 0) out << ", ";
+    out << "\n  {\"name\": \"" << result.name << "\", \"iterations\": "
+        << result.iterations << ", \"mean_seconds\": " << result.meanSeconds
+        << ", \"min_seconds\": " << result.minSeconds;
+    if (result.itemsPerIteration > 0) {
+      out << ", \"" << result.itemName << "_per_second\": "
+          << result.itemsPerIteration / result.meanSeconds;
+    }
+    out << '}';
+  }
+  out << "\n]}" << std::endl;
+  out.flags(flags);
+}
@@ -0,0 +1,64 @@
+#ifndef EAX_BENCHMARK_H
+#define EAX_BENCHMARK_H
+
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace eax {
+
+/// Returns the seconds it takes to call "fn", e.g. to measure the part of a
+/// benchmark iteration after its setup.
+template<typename FnT>
+double measure(FnT&& fn) {
+  auto start = std::chrono::steady_clock::now();
+  fn();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Runs benchmarks and collects their results. Each benchmark is a function
+/// that runs one iteration, and returns the seconds spent in the part of it
+/// being measured, so that it can exclude its setup.
+class BenchmarkRunner {
+public:
+  struct Result {
+    std::string name;
+    uint64_t iterations;
+    double meanSeconds;
+    double minSeconds;
+    double itemsPerIteration;
+    std::string itemName; // What the items are, e.g. "bytes".
+  };
+  
+public:
+  /// Runs each benchmark whose name contains "filter" until the measured
+  /// time adds up to at least "minSeconds".
+  BenchmarkRunner(std::string filter, double minSeconds)
+    : filter(std::move(filter)), minSeconds(minSeconds) {}
+  
+  void run(std::string const& name, double itemsPerIteration,
+           std::string const& itemName, std::function<double()> iteration);
+  
+  /// Prints the result of each benchmark as it completes.
+  void setProgressStream(std::ostream* stream) { progressStream = stream; }
+  
+  /// Prints the results as a JSON object, with "context" as an additional
+  /// member, which must be a JSON object itself.
+  void printJSON(std::ostream& out, std::string const& context) const;
+  
+private:
+  void printResult(std::ostream& out, Result const& result) const;
+  
+private:
+  std::string filter;
+  double minSeconds;
+  std::ostream* progressStream = nullptr;
+  std::vector<Result> results;
+};
+
+}
+
+#endif
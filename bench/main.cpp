@@ -0,0 +1,252 @@
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include "benchmark.h"
+#include "program_generator.h"
+#include "../src/ir_gen/ir_gen.h"
+#include "../src/ir_gen/optimizer.h"
+#include "../src/parser/lexer.h"
+#include "../src/parser/script_parser.h"
+#include "../src/repl/jit.h"
+#include "../src/util/error.h"
+
+using namespace eax;
+namespace cl = llvm::cl;
+
+static cl::OptionCategory benchCategory("eax-bench options");
+static cl::opt<std::string> filter("filter",
+  cl::desc("Only run the benchmarks whose name contains the given string"),
+  cl::value_desc("string"), cl::cat(benchCategory));
+static cl::opt<unsigned> programSize("size",
+  cl::desc("Number of functions in the generated program (default 200)"),
+  cl::init(200), cl::cat(benchCategory));
+static cl::opt<unsigned> seed("seed",
+  cl::desc("Seed of the generated program (default 1)"),
+  cl::init(1), cl::cat(benchCategory));
+static cl::opt<double> minTime("min-time",
+  cl::desc("Seconds to run each benchmark for, at least (default 0.5)"),
+  cl::init(0.5), cl::cat(benchCategory));
+static cl::opt<std::string> jsonFile("json",
+  cl::desc("Write the results as JSON to a file"),
+  cl::value_desc("file"), cl::cat(benchCategory));
+
+/// The kernels whose execution is measured. Each loop calls its kernel
+/// with arguments between 0 and 1, and sums the results.
+static std::string getKernelSource() {
+  return "def fib(n) if n < 2 then n else fib(n - 1) + fib(n - 2)\n"
+         "def poly(x) " + generatePolynomial(16, seed) + "\n"
+         "def polyloop(n, acc) if n < 1 then acc "
+         "else polyloop(n - 1, acc + poly(n / 10000))\n"
+         "def deep(x) " + generateExpression(12, seed) + "\n"
+         "def deeploop(n, acc) if n < 1 then acc "
+         "else deeploop(n - 1, acc + deep(n / 1000))\n";
+}
+
+static std::vector<std::unique_ptr<Function>> parse(llvm::StringRef source) {
+  std::vector<std::unique_ptr<Function>> fns;
+  for (auto& item : parseScript(source, 1)) {
+    if (item.kind != ScriptItem::Definition) {
+      fatalError("generated program doesn't parse: ", item.diagnostics);
+    }
+    fns.push_back(std::move(item.fn));
+  }
+  return fns;
+}
+
+namespace {
+
+/// Generates the IR of definitions like a Session does, each into a module
+/// of its own.
+class Compiler {
+public:
+  Compiler(JIT& jit) : targetMachine(jit.createTargetMachine()), irgen(context) {
+    irgen.setFnPassManager(nullptr);
+  }
+  
+  std::unique_ptr<llvm::Module> createModule() {
+    auto module = llvm::make_unique<llvm::Module>("eaxbench", context);
+    module->setDataLayout(targetMachine->createDataLayout());
+    return module;
+  }
+  
+  /// Generates the IR of "fn" into "module", and optimizes it if "optimize"
+  /// is set.
+  void generate(Function& fn, llvm::Module& module, bool optimize = true) {
+    std::unique_ptr<llvm::legacy::FunctionPassManager> fnPassManager;
+    if (optimize) fnPassManager = createFnPassManager(module, *targetMachine);
+    irgen.setModule(module);
+    irgen.setFnPassManager(fnPassManager.get());
+    fn.accept(irgen);
+    irgen.setFnPassManager(nullptr);
+    if (!irgen.getResult()) fatalError("couldn't generate the IR of a benchmark");
+  }
+  
+  /// Generates and optimizes the IR of all of "fns" into one module.
+  std::unique_ptr<llvm::Module> generate(std::vector<std::unique_ptr<Function>>& fns) {
+    auto module = createModule();
+    for (auto& fn : fns) generate(*fn, *module);
+    return module;
+  }
+  
+  llvm::TargetMachine& getTargetMachine() { return *targetMachine; }
+  
+private:
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  llvm::LLVMContext context; // Must outlive irgen.
+  IrGen irgen;
+};
+
+}
+
+static void runFrontendBenchmarks(BenchmarkRunner& runner, std::string const& program) {
+  runner.run("lex", program.size(), "bytes", [&] {
+    Lexer lexer;
+    lexer.setInput(program);
+    return measure([&] {
+      while (lexer.nextToken() != TokenEof) {}
+    });
+  });
+  
+  runner.run("parse", programSize, "definitions", [&] {
+    return measure([&] { parseScript(program, 1); });
+  });
+}
+
+static void runCompilerBenchmarks(BenchmarkRunner& runner, JIT& jit,
+                                  std::string const& program) {
+  auto fns = parse(program);
+  
+  runner.run("irgen", fns.size(), "definitions", [&] {
+    Compiler compiler(jit);
+    auto module = compiler.createModule();
+    return measure([&] {
+      for (auto& fn : fns) compiler.generate(*fn, *module, false);
+    });
+  });
+  
+  runner.run("optimize", fns.size(), "definitions", [&] {
+    Compiler compiler(jit);
+    auto module = compiler.createModule();
+    for (auto& fn : fns) compiler.generate(*fn, *module, false);
+    auto fnPassManager = createFnPassManager(*module, compiler.getTargetMachine());
+    return measure([&] {
+      for (auto& fn : *module) {
+        if (!fn.isDeclaration()) fnPassManager->run(fn);
+      }
+    });
+  });
+  
+  runner.run("codegen", fns.size(), "definitions", [&] {
+    Compiler compiler(jit);
+    auto module = compiler.generate(fns);
+    auto name = JIT::getFirstDefinitionName(*module);
+    JIT::ModuleHandleT moduleHandle;
+    double seconds = measure([&] {
+      moduleHandle = jit.addModule(std::move(module));
+      if (!jit.getSymbolAddressIn(moduleHandle, name)) fatalError("codegen failed");
+    });
+    jit.removeModule(moduleHandle);
+    return seconds;
+  });
+}
+
+static void runJITBenchmarks(BenchmarkRunner& runner, JIT& jit) {
+  Compiler compiler(jit);
+  auto fns = parse("def benchfn(x, y) x * y + 1\n");
+  auto createDefinition = [&] {
+    auto module = compiler.createModule();
+    compiler.generate(*fns.front(), *module);
+    return module;
+  };
+  jit.addDefinitions(createDefinition());
+  
+  runner.run("jit.add", 1, "definitions", [&] {
+    auto module = createDefinition();
+    // Supersedes, and removes, the previous definition.
+    return measure([&] { jit.addDefinitions(std::move(module)); });
+  });
+  
+  unsigned const numLookups = 1000;
+  runner.run("jit.lookup", numLookups, "lookups", [&] {
+    return measure([&] {
+      for (unsigned i = 0; i < numLookups; ++i) {
+        if (!jit.findSymbol("benchfn")) fatalError("lookup failed");
+      }
+    });
+  });
+  
+  runner.run("jit.remove", 1, "modules", [&] {
+    auto moduleHandle = jit.addModule(createDefinition());
+    jit.getSymbolAddressIn(moduleHandle, "benchfn");
+    return measure([&] { jit.removeModule(moduleHandle); });
+  });
+}
+
+static void runExecutionBenchmarks(BenchmarkRunner& runner, JIT& jit) {
+  Compiler compiler(jit);
+  for (auto& fn : parse(getKernelSource())) {
+    auto module = compiler.createModule();
+    compiler.generate(*fn, *module);
+    jit.addDefinitions(std::move(module));
+  }
+  
+  auto fib = reinterpret_cast<double(*)(double)>(jit.findSymbol("fib").getAddress());
+  auto polyloop = reinterpret_cast<double(*)(double, double)>(
+    jit.findSymbol("polyloop").getAddress());
+  auto deeploop = reinterpret_cast<double(*)(double, double)>(
+    jit.findSymbol("deeploop").getAddress());
+  // Keep the results alive, so that the calls can't be dropped.
+  volatile double sink;
+  
+  // fib(25) makes 2 * fib(26) - 1 calls.
+  runner.run("exec.fib", 242785, "calls", [&] {
+    return measure([&] { sink = fib(25); });
+  });
+  
+  runner.run("exec.poly", 10000, "evaluations", [&] {
+    return measure([&] { sink = polyloop(10000, 0); });
+  });
+  
+  runner.run("exec.deep", 1000, "evaluations", [&] {
+    return measure([&] { sink = deeploop(1000, 0); });
+  });
+  (void)sink;
+}
+
+int main(int argc, char** argv) {
+  cl::HideUnrelatedOptions(benchCategory);
+  cl::ParseCommandLineOptions(argc, argv, "eax compiler and runtime benchmarks\n");
+  
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+  
+  ProgramOptions programOptions;
+  programOptions.numFunctions = programSize;
+  programOptions.seed = seed;
+  auto program = generateProgram(programOptions);
+  
+  JIT jit;
+  BenchmarkRunner runner(filter, minTime);
+  runner.setProgressStream(&std::cout);
+  runFrontendBenchmarks(runner, program);
+  runCompilerBenchmarks(runner, jit, program);
+  runJITBenchmarks(runner, jit);
+  runExecutionBenchmarks(runner, jit);
+  
+  if (!jsonFile.empty()) {
+    std::ostringstream context;
+    context << "{\"size\": " << programSize << ", \"seed\": " << seed
+            << ", \"program_bytes\": " << program.size()
+            << ", \"min_time\": " << minTime << '}';
+    std::ofstream file(jsonFile);
+    runner.printJSON(file, context.str());
+    if (!file) fatalError("couldn't write '", jsonFile, "'");
+  }
+}
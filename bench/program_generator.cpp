@@ -0,0 +1,125 @@
+#include <vector>
+
+#include "program_generator.h"
+
+using namespace eax;
+
+namespace {
+
+/// A small random number generator whose output, unlike that of the
+/// standard distributions, is the same with every standard library.
+class Random {
+public:
+  Random(uint32_t seed) : state(seed * 2654435761u + 1) {}
+  
+  /// Returns a number in [0, bound).
+  uint32_t next(uint32_t bound) {
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % bound;
+  }
+  
+  /// Returns a number with two decimals in (-range, range).
+  std::string nextNumber(unsigned range) {
+    int hundredths = int(next(range * 200)) - int(range * 100);
+    std::string sign = hundredths < 0 ? "-" : "";
+    unsigned magnitude = hundredths < 0 ? -hundredths : hundredths;
+    std::string fraction = std::to_string(magnitude % 100);
+    if (fraction.size() == 1) fraction = "0" + fraction;
+    return "(" + sign + std::to_string(magnitude / 100) + "." + fraction + ")";
+  }
+  
+private:
+  uint32_t state;
+};
+
+class ProgramGenerator {
+public:
+  ProgramGenerator(uint32_t seed) : random(seed) {}
+  
+  std::string generateExpr(unsigned depth, std::vector<std::string> const& params,
+                           unsigned numCallees) {
+    if (depth == 0) {
+      if (!params.empty() && random.next(3) != 0) {
+        return params[random.next(uint32_t(params.size()))];
+      }
+      return random.nextNumber(10);
+    }
+    
+    auto subexpr = [&] { return generateExpr(depth - 1, params, numCallees); };
+    
+    switch (random.next(8)) {
+    case 0:
+    case 1: return "(" + subexpr() + " + " + subexpr() + ")";
+    case 2: return "(" + subexpr() + " - " + subexpr() + ")";
+    case 3: return "(" + subexpr() + " * " + subexpr() + ")";
+    case 4:
+      return "(if " + subexpr() + " < " + subexpr() + " then " + subexpr() +
+             " else " + subexpr() + ")";
+    case 5: return "sqrt(abs(" + subexpr() + "))";
+    case 6: return "max(" + subexpr() + ", " + subexpr() + ")";
+    default: {
+      if (numCallees == 0) return subexpr();
+      unsigned callee = random.next(numCallees);
+      std::string call = "f" + std::to_string(callee) + "(";
+      for (unsigned i = 0; i < calleeArities[callee]; ++i) {
+        if (i > 0) call += ", ";
+        // Keep calls shallow, so the size of the program stays linear in
+        // the number of functions.
+        call += generateExpr(depth > 2 ? 1 : 0, params, 0);
+      }
+      return call + ")";
+    }
+    }
+  }
+  
+  std::string generateFunction(unsigned index, ProgramOptions const& options) {
+    std::vector<std::string> params;
+    unsigned numParams = random.next(options.maxParams + 1);
+    for (unsigned i = 0; i < numParams; ++i) {
+      params.push_back(std::string(1, char('a' + i)));
+    }
+    calleeArities.push_back(numParams);
+    
+    std::string definition = "def f" + std::to_string(index) + "(";
+    for (unsigned i = 0; i < numParams; ++i) {
+      if (i > 0) definition += ", ";
+      definition += params[i];
+    }
+    definition += ") ";
+    // Only call functions defined earlier.
+    definition += generateExpr(options.exprDepth, params, index);
+    return definition + "\n";
+  }
+  
+private:
+  Random random;
+  std::vector<unsigned> calleeArities;
+};
+
+}
+
+std::string eax::generateProgram(ProgramOptions const& options) {
+  ProgramGenerator generator(options.seed);
+  std::string program;
+  for (unsigned i = 0; i < options.numFunctions; ++i) {
+    program += generator.generateFunction(i, options);
+  }
+  return program;
+}
+
+std::string eax::generateExpression(unsigned depth, uint32_t seed) {
+  ProgramGenerator generator(seed);
+  return generator.generateExpr(depth, {"x"}, 0);
+}
+
+std::string eax::generatePolynomial(unsigned degree, uint32_t seed) {
+  Random random(seed);
+  std::string polynomial = random.nextNumber(1);
+  for (unsigned i = 0; i < degree; ++i) {
+    polynomial = "(" + polynomial + " * x + " + random.nextNumber(1) + ")";
+  }
+  return polynomial;
+}
@@ -0,0 +1,33 @@
+#ifndef EAX_PROGRAM_GENERATOR_H
+#define EAX_PROGRAM_GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+namespace eax {
+
+/// The shape of a generated program. The same options always generate the
+/// same program, on every platform.
+struct ProgramOptions {
+  unsigned numFunctions = 100;
+  unsigned maxParams = 3;
+  unsigned exprDepth = 6; // Depth of each function's body.
+  uint32_t seed = 1;
+};
+
+/// Generates a program of function definitions, one per line. Each function
+/// computes a number from its parameters with arithmetic, comparisons, if
+/// expressions, builtin calls and calls to the functions defined before it.
+std::string generateProgram(ProgramOptions const& options);
+
+/// Generates an arithmetic expression of the given depth over the variable
+/// "x", with about 2^depth leaves.
+std::string generateExpression(unsigned depth, uint32_t seed);
+
+/// Generates the polynomial of the given degree in "x" in Horner form,
+/// with coefficients between -1 and 1.
+std::string generatePolynomial(unsigned degree, uint32_t seed);
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include <llvm/Support/MathExtras.h>
+
+#include "ast_hasher.h"
+#include "expr.h"
+#include "function.h"
+
+using namespace eax;
+
+// Each node is hashed with a distinct tag, followed by its children in
+// order, so that differently shaped trees get different hashes.
+
+void AstHasher::visit(VariableExpr& expr) {
+  combine('v', expr.getName());
+}
+
+void AstHasher::visit(UnaryExpr& expr) {
+  combine('u', expr.getOp());
+  expr.getOperand().accept(*this);
+}
+
+void AstHasher::visit(BinaryExpr& expr) {
+  combine('b', expr.getOp());
+  expr.getLhs().accept(*this);
+  expr.getRhs().accept(*this);
+}
+
+void AstHasher::visit(CallExpr& expr) {
+  combine('c', expr.getName(), expr.getArgs().size());
+  callees.push_back(expr.getName());
+  for (auto const& arg : expr.getArgs()) {
+    arg->accept(*this);
+  }
+}
+
+void AstHasher::visit(NumberExpr& expr) {
+  combine('n', llvm::DoubleToBits(expr.getValue()));
+}
+
+void AstHasher::visit(BoolExpr& expr) {
+  combine('t', expr.getValue());
+}
+
+void AstHasher::visit(IfExpr& expr) {
+  combine('i');
+  expr.getCondition().accept(*this);
+  expr.getThen().accept(*this);
+  expr.getElse().accept(*this);
+}
+
+void AstHasher::visit(TupleExpr& expr) {
+  combine('(', expr.getElements().size());
+  for (auto const& element : expr.getElements()) {
+    element->accept(*this);
+  }
+}
+
+void AstHasher::visit(LetExpr& expr) {
+  combine('l', expr.isDestructuring(), expr.getNames().size());
+  for (auto const& name : expr.getNames()) {
+    combine(name);
+  }
+  expr.getValue().accept(*this);
+  expr.getBody().accept(*this);
+}
+
+void AstHasher::visit(Function& function) {
+  function.getPrototype()->accept(*this);
+  function.getBody().accept(*this);
+}
+
+void AstHasher::visit(Prototype& proto) {
+  combine('p', proto.getName(), proto.getParamNames().size());
+  for (auto const& paramName : proto.getParamNames()) {
+    combine(paramName);
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef EAX_AST_HASHER_H
+#define EAX_AST_HASHER_H
+
+#include <string>
+#include <vector>
+#include <llvm/ADT/Hashing.h>
+
+#include "ast_visitor.h"
+
+namespace eax {
+
+/// Computes a hash of the structure of the visited AST nodes, so that
+/// structurally identical expressions can be recognized cheaply. Also
+/// collects the names of the functions they call.
+class AstHasher : public AstVisitor {
+public:
+  size_t getHash() const { return hash; }
+  std::vector<std::string> const& getCallees() const { return callees; }
+  
+private:
+  void visit(VariableExpr&) override;
+  void visit(UnaryExpr&) override;
+  void visit(BinaryExpr&) override;
+  void visit(CallExpr&) override;
+  void visit(NumberExpr&) override;
+  void visit(BoolExpr&) override;
+  void visit(IfExpr&) override;
+  void visit(TupleExpr&) override;
+  void visit(LetExpr&) override;
+  void visit(Function&) override;
+  void visit(Prototype&) override;
+  
+  template<typename... Ts>
+  void combine(Ts const&... values) {
+    hash = llvm::hash_combine(hash, values...);
+  }
+  
+private:
+  llvm::hash_code hash = llvm::hash_code(0);
+  std::vector<std::string> callees;
+};
+
+}
+
+#endif
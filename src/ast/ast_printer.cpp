@@ -51,6 +51,31 @@ void AstPrinter::visit(IfExpr& expr) {
   expr.getElse().accept(*this);
 }
 
+void AstPrinter::visit(TupleExpr& expr) {
+  out << "(";
+  auto const& elements = expr.getElements();
+  for (auto i = elements.begin(), e = elements.end(); i != e; ++i) {
+    (*i)->accept(*this);
+    if (i != e-1) out << ", ";
+  }
+  out << ")";
+}
+
+void AstPrinter::visit(LetExpr& expr) {
+  out << "let ";
+  if (expr.isDestructuring()) out << "(";
+  auto const& names = expr.getNames();
+  for (auto i = names.begin(), e = names.end(); i != e; ++i) {
+    out << *i;
+    if (i != e-1) out << ", ";
+  }
+  if (expr.isDestructuring()) out << ")";
+  out << " = ";
+  expr.getValue().accept(*this);
+  out << " in ";
+  expr.getBody().accept(*this);
+}
+
 void AstPrinter::visit(Function& expr) {
   // TODO
 }
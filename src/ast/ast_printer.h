@@ -19,6 +19,8 @@ private:
   void visit(NumberExpr&) override;
   void visit(BoolExpr&) override;
   void visit(IfExpr&) override;
+  void visit(TupleExpr&) override;
+  void visit(LetExpr&) override;
   void visit(Function&) override;
   void visit(Prototype&) override;
   
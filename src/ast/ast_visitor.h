@@ -10,6 +10,8 @@ class CallExpr;
 class NumberExpr;
 class BoolExpr;
 class IfExpr;
+class TupleExpr;
+class LetExpr;
 class Function;
 class Prototype;
 
@@ -22,6 +24,8 @@ public:
   virtual void visit(NumberExpr&) = 0;
   virtual void visit(BoolExpr&) = 0;
   virtual void visit(IfExpr&) = 0;
+  virtual void visit(TupleExpr&) = 0;
+  virtual void visit(LetExpr&) = 0;
   virtual void visit(Function&) = 0;
   virtual void visit(Prototype&) = 0;
 };
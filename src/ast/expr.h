@@ -113,6 +113,41 @@ private:
   std::unique_ptr<Expr> elseBranch;
 };
 
+/// Expression class for tuples of several values, e.g. "(min, max)", which
+/// let a function return all of them from a single call.
+class TupleExpr : public Expr {
+public:
+  TupleExpr(std::vector<std::unique_ptr<Expr>> elements)
+    : elements(std::move(elements)) {}
+  void accept(AstVisitor& visitor) override { visitor.visit(*this); }
+  llvm::ArrayRef<std::unique_ptr<Expr>> getElements() const { return elements; }
+  
+private:
+  std::vector<std::unique_ptr<Expr>> elements;
+};
+
+/// Expression class for "let name = value in body", which binds a variable
+/// in "body", and "let (name, ...) = value in body", which binds the
+/// elements of a tuple.
+class LetExpr : public Expr {
+public:
+  LetExpr(std::vector<std::string> names, bool destructuring,
+          std::unique_ptr<Expr> value, std::unique_ptr<Expr> body)
+    : names(std::move(names)), destructuring(destructuring),
+      value(std::move(value)), body(std::move(body)) {}
+  void accept(AstVisitor& visitor) override { visitor.visit(*this); }
+  llvm::ArrayRef<std::string> getNames() const { return names; }
+  bool isDestructuring() const { return destructuring; }
+  Expr& getValue() const { return *value; }
+  Expr& getBody() const { return *body; }
+  
+private:
+  std::vector<std::string> names;
+  bool destructuring;
+  std::unique_ptr<Expr> value;
+  std::unique_ptr<Expr> body;
+};
+
 }
 
 #endif
@@ -3,6 +3,8 @@
 
 #include <vector>
 #include <string>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
 
 #include "ast_node.h"
 
@@ -0,0 +1,87 @@
+#include <unordered_map>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+
+#include "ir_gen.h"
+#include "../ast/expr.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+namespace {
+
+/// A builtin math function that is lowered to an LLVM intrinsic.
+struct Builtin {
+  llvm::Intrinsic::ID intrinsic;
+  unsigned arity;
+  unsigned cost; // In simple operations, see IrGen::getSpeculationCost().
+};
+
+}
+
+/// The cost of the builtins that are calls to libm, which are never worth
+/// computing speculatively.
+static unsigned const expensiveCost = 20;
+
+// All of these are overloaded on the floating-point type, which is always
+// double here. Intrinsics with a hardware instruction (sqrt, fabs, fma, ...)
+// are selected directly; the rest are constant-folded by the optimizer and
+// otherwise lowered to the corresponding libm function by the code generator.
+static std::unordered_map<std::string, Builtin> const builtins = {
+  {"sqrt", {llvm::Intrinsic::sqrt, 1, 4}},
+  {"abs", {llvm::Intrinsic::fabs, 1, 1}},
+  {"fabs", {llvm::Intrinsic::fabs, 1, 1}},
+  {"floor", {llvm::Intrinsic::floor, 1, 1}},
+  {"ceil", {llvm::Intrinsic::ceil, 1, 1}},
+  {"trunc", {llvm::Intrinsic::trunc, 1, 1}},
+  {"round", {llvm::Intrinsic::round, 1, 2}},
+  {"rint", {llvm::Intrinsic::rint, 1, 1}},
+  {"min", {llvm::Intrinsic::minnum, 2, 1}},
+  {"max", {llvm::Intrinsic::maxnum, 2, 1}},
+  {"copysign", {llvm::Intrinsic::copysign, 2, 1}},
+  {"fma", {llvm::Intrinsic::fma, 3, 1}},
+  {"sin", {llvm::Intrinsic::sin, 1, expensiveCost}},
+  {"cos", {llvm::Intrinsic::cos, 1, expensiveCost}},
+  {"exp", {llvm::Intrinsic::exp, 1, expensiveCost}},
+  {"exp2", {llvm::Intrinsic::exp2, 1, expensiveCost}},
+  {"log", {llvm::Intrinsic::log, 1, expensiveCost}},
+  {"log2", {llvm::Intrinsic::log2, 1, expensiveCost}},
+  {"log10", {llvm::Intrinsic::log10, 1, expensiveCost}},
+  {"pow", {llvm::Intrinsic::pow, 2, expensiveCost}},
+};
+
+bool IrGen::isBuiltin(llvm::StringRef name) {
+  return builtins.count(name) != 0;
+}
+
+unsigned IrGen::getBuiltinCost(llvm::StringRef name) {
+  return builtins.at(name).cost;
+}
+
+void IrGen::codegenBuiltinCall(CallExpr& expr) {
+  auto const& builtin = builtins.at(expr.getName());
+  llvm::ArrayRef<std::unique_ptr<Expr>> const args = expr.getArgs();
+  
+  if (args.size() != builtin.arity)
+    return values.push(error("wrong number of arguments, expected ",
+                             builtin.arity));
+  
+  std::vector<llvm::Value*> argValues;
+  argValues.reserve(args.size());
+  
+  for (auto const& arg : args) {
+    arg->accept(*this);
+    llvm::Value* argValue = values.top();
+    if (!argValue) return;
+    values.pop();
+    
+    if (!argValue->getType()->isDoubleTy())
+      return values.push(error("'", expr.getName(),
+                               "' requires Number arguments"));
+    argValues.push_back(argValue);
+  }
+  
+  llvm::Function* intrinsic = llvm::Intrinsic::getDeclaration(
+    module, builtin.intrinsic, llvm::Type::getDoubleTy(context));
+  values.push(builder.CreateCall(intrinsic, argValues, "calltmp"));
+}
@@ -55,6 +55,9 @@ void IrGen::visit(UnaryExpr& expr) {
   if (!operandValue) return;
   values.pop();
   
+  if (operandValue->getType()->isStructTy())
+    return values.push(error("unary operators can't be applied to tuples"));
+  
   llvm::Value* v;
   
   switch (expr.getOp()) {
@@ -86,6 +89,9 @@ void IrGen::codegenAssignment(BinaryExpr& expr) {
   auto variableIter = namedValues.find(lhsVar->getName());
   if (variableIter == namedValues.end())
     return values.push(error("unknown variable name"));
+  if (rhsValue->getType() != variableIter->second->getAllocatedType())
+    return values.push(error("can't assign a value of another type to '",
+                             lhsVar->getName(), "'"));
   
   builder.CreateStore(rhsValue, variableIter->second);
   values.push(rhsValue);
@@ -95,6 +101,9 @@ void IrGen::visit(BinaryExpr& expr) {
   // Special case for '=' because we don't want to emit lhs as an expression.
   if (expr.getOp() == '=') return codegenAssignment(expr);
   
+  // '&&' and '||' don't always evaluate their rhs.
+  if (expr.getOp() == '&&' || expr.getOp() == '||') return codegenLogicalOperator(expr);
+  
   expr.getLhs().accept(*this);
   llvm::Value* left = values.top();
   if (!left) return;
@@ -105,6 +114,9 @@ void IrGen::visit(BinaryExpr& expr) {
   if (!right) return;
   values.pop();
   
+  if (left->getType()->isStructTy() || right->getType()->isStructTy())
+    return values.push(error("binary operators can't be applied to tuples"));
+  
   llvm::Value* v;
   
   switch (expr.getOp()) {
@@ -126,7 +138,11 @@ void IrGen::visit(BinaryExpr& expr) {
 
 void IrGen::visit(CallExpr& expr) {
   llvm::Function* fn = getFunction(expr.getName());
-  if (!fn) return values.push(error("unknown function name"));
+  if (!fn) {
+    // User definitions shadow the builtins.
+    if (isBuiltin(expr.getName())) return codegenBuiltinCall(expr);
+    return values.push(error("unknown function name"));
+  }
   llvm::ArrayRef<std::unique_ptr<Expr>> const args = expr.getArgs();
   
   if (fn->arg_size() != args.size())
@@ -138,12 +154,26 @@ void IrGen::visit(CallExpr& expr) {
   
   for (auto const& arg : args) {
     arg->accept(*this);
-    argValues.push_back(values.top());
+    llvm::Value* argValue = values.top();
+    if (!argValue) return;
     values.pop();
-    assert(argValues.back());
+    
+    if (!argValue->getType()->isDoubleTy())
+      return values.push(error("'", expr.getName(),
+                               "' requires Number arguments"));
+    argValues.push_back(argValue);
   }
   
-  values.push(builder.CreateCall(fn, argValues, "calltmp"));
+  unsigned counter = reservePGOCounters(1);
+  createPGOIncrement(counter);
+  auto call = builder.CreateCall(fn, argValues, "calltmp");
+  // A call that wasn't made during profiling, although the function was
+  // entered, is probably an error path, so keep it out of the hot code.
+  auto count = getPGOCount(counter), entryCount = getPGOCount(0);
+  if (count && entryCount && *count == 0 && *entryCount > 0) {
+    call->addAttribute(llvm::AttributeSet::FunctionIndex, llvm::Attribute::Cold);
+  }
+  values.push(call);
 }
 
 void IrGen::visit(NumberExpr& expr) {
@@ -162,9 +192,21 @@ void IrGen::visit(IfExpr& expr) {
   if (!conditionValue) return;
   values.pop();
   
-  // Convert condition to a bool by comparing to 0.
-  conditionValue = builder.CreateFCmpONE(
-    conditionValue, llvm::ConstantFP::get(context, llvm::APFloat(0.0)), "ifcond");
+  if (conditionValue->getType()->isStructTy())
+    return values.push(error("the condition of 'if' can't be a tuple"));
+  
+  // Bools are used as they are, and Numbers are converted to a bool by
+  // comparing to 0.
+  if (conditionValue->getType()->isDoubleTy()) {
+    conditionValue = builder.CreateFCmpONE(
+      conditionValue, llvm::ConstantFP::get(context, llvm::APFloat(0.0)), "ifcond");
+  }
+  
+  // Evaluate cheap branches without side effects unconditionally and select
+  // the result, so that an unpredictable condition costs no mispredictions.
+  if (getSpeculationCost(expr.getThen()) + getSpeculationCost(expr.getElse())
+      <= maxSpeculationCost)
+    return codegenSelect(expr, conditionValue);
   
   llvm::Function* fn = builder.GetInsertBlock()->getParent();
   
@@ -172,15 +214,21 @@ void IrGen::visit(IfExpr& expr) {
   llvm::BasicBlock* elseBlock = llvm::BasicBlock::Create(context, "else");
   llvm::BasicBlock* mergeBlock = llvm::BasicBlock::Create(context, "ifcont");
   
-  builder.CreateCondBr(conditionValue, thenBlock, elseBlock);
+  // Count each branch, or weight them by their profiled counts.
+  unsigned counters = reservePGOCounters(2);
+  auto thenCount = getPGOCount(counters), elseCount = getPGOCount(counters + 1);
+  llvm::MDNode* weights = nullptr;
+  if (thenCount && elseCount) weights = createBranchWeights(*thenCount, *elseCount);
+  builder.CreateCondBr(conditionValue, thenBlock, elseBlock, weights);
   
   // then
   
   builder.SetInsertPoint(thenBlock);
+  createPGOIncrement(counters);
   
   expr.getThen().accept(*this);
   llvm::Value* thenValue = values.top();
-  if (!thenValue) return;
+  if (!thenValue && !assumedReturnType) return;
   values.pop();
   
   builder.CreateBr(mergeBlock);
@@ -190,10 +238,11 @@ void IrGen::visit(IfExpr& expr) {
   
   fn->getBasicBlockList().push_back(elseBlock);
   builder.SetInsertPoint(elseBlock);
+  createPGOIncrement(counters + 1);
   
   expr.getElse().accept(*this);
   llvm::Value* elseValue = values.top();
-  if (!elseValue) return;
+  if (!elseValue && !assumedReturnType) return;
   values.pop();
   
   builder.CreateBr(mergeBlock);
@@ -204,9 +253,89 @@ void IrGen::visit(IfExpr& expr) {
   fn->getBasicBlockList().push_back(mergeBlock);
   builder.SetInsertPoint(mergeBlock);
   
-  llvm::PHINode* phi = builder.CreatePHI(
-    llvm::Type::getDoubleTy(context), 2, "iftmp");
+  if (!thenValue || !elseValue || thenValue->getType() != elseValue->getType()) {
+    if (!assumedReturnType)
+      return values.push(error("the branches of 'if' must have the same type"));
+    
+    // While the return type of a recursive function is being inferred, a
+    // branch may fail or have the wrong type only because a recursive call
+    // has the wrong type. Go by the branch that succeeded, preferably one
+    // that doesn't just have the assumed type.
+    llvm::Value* value = !thenValue ? elseValue : !elseValue ? thenValue
+      : thenValue->getType() != assumedReturnType ? thenValue : elseValue;
+    if (!value) return values.push(nullptr);
+    return values.push(llvm::UndefValue::get(value->getType()));
+  }
+  
+  llvm::PHINode* phi = builder.CreatePHI(thenValue->getType(), 2, "iftmp");
   phi->addIncoming(thenValue, thenBlock);
   phi->addIncoming(elseValue, elseBlock);
   values.push(phi);
 }
+
+void IrGen::visit(TupleExpr& expr) {
+  std::vector<llvm::Value*> elementValues;
+  std::vector<llvm::Type*> elementTypes;
+  
+  for (auto const& element : expr.getElements()) {
+    element->accept(*this);
+    llvm::Value* elementValue = values.top();
+    if (!elementValue) return;
+    values.pop();
+    
+    if (elementValue->getType()->isStructTy())
+      return values.push(error("tuples can't contain tuples"));
+    elementValues.push_back(elementValue);
+    elementTypes.push_back(elementValue->getType());
+  }
+  
+  // Tuples are literal structs, which are returned in registers as far as
+  // the target's calling convention allows.
+  llvm::Value* tuple = llvm::UndefValue::get(
+    llvm::StructType::get(context, elementTypes));
+  for (unsigned i = 0; i < elementValues.size(); ++i) {
+    tuple = builder.CreateInsertValue(tuple, elementValues[i], i, "tupletmp");
+  }
+  values.push(tuple);
+}
+
+void IrGen::visit(LetExpr& expr) {
+  expr.getValue().accept(*this);
+  llvm::Value* value = values.top();
+  if (!value) return;
+  values.pop();
+  
+  llvm::ArrayRef<std::string> const names = expr.getNames();
+  std::vector<llvm::Value*> boundValues;
+  
+  if (expr.isDestructuring()) {
+    auto tupleType = llvm::dyn_cast<llvm::StructType>(value->getType());
+    if (!tupleType || tupleType->getNumElements() != names.size())
+      return values.push(error("expected a tuple of ", names.size(), " values"));
+    
+    for (unsigned i = 0; i < names.size(); ++i) {
+      boundValues.push_back(builder.CreateExtractValue(value, i, names[i]));
+    }
+  } else {
+    boundValues.push_back(value);
+  }
+  
+  // Bind the names in the body, shadowing any variables of the same names.
+  llvm::Function* fn = builder.GetInsertBlock()->getParent();
+  std::vector<std::pair<std::string, llvm::AllocaInst*>> shadowed;
+  
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto alloca = createEntryBlockAlloca(fn, boundValues[i]->getType(), names[i]);
+    builder.CreateStore(boundValues[i], alloca);
+    auto& variable = namedValues[names[i]];
+    shadowed.push_back({names[i], variable});
+    variable = alloca;
+  }
+  
+  expr.getBody().accept(*this);
+  
+  for (auto i = shadowed.rbegin(), e = shadowed.rend(); i != e; ++i) {
+    if (i->second) namedValues[i->first] = i->second;
+    else namedValues.erase(i->first);
+  }
+}
@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <sstream>
+#include <llvm/ADT/STLExtras.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IR/Function.h>
 
 #include "ir_gen.h"
+#include "../ast/ast_hasher.h"
 #include "../ast/function.h"
+#include "../util/call_profiler.h"
 #include "../util/error.h"
+#include "../util/timings.h"
 
 using namespace eax;
 
@@ -11,7 +17,8 @@ void IrGen::createParamAllocas(Prototype const& proto, llvm::Function* fn) {
   llvm::Function::arg_iterator argIter = fn->arg_begin();
   
   for (auto& paramName : proto.getParamNames()) {
-    llvm::AllocaInst* alloca = createEntryBlockAlloca(fn, paramName);
+    llvm::AllocaInst* alloca = createEntryBlockAlloca(
+      fn, llvm::Type::getDoubleTy(context), paramName);
     builder.CreateStore(&*argIter, alloca);
     namedValues[paramName] = alloca;
     ++argIter;
@@ -43,39 +50,198 @@ llvm::Function* IrGen::initFunction(Function& function, Prototype& proto) {
   
   namedValues.clear();
   createParamAllocas(proto, fn);
+  // Counter 0 counts the function's entries.
+  nextPGOCounter = 0;
+  createPGOIncrement(reservePGOCounters(1));
   
   function.getBody().accept(*this);
   return fn;
 }
 
+/// Generates the body of a function to find its return type, and removes the
+/// generated function again. Returns null if the body can't be generated.
+llvm::Type* IrGen::inferReturnType(Function& function, Prototype& proto) {
+  auto generate = [&]() -> llvm::Type* {
+    llvm::Function* fn = initFunction(function, proto);
+    llvm::Value* value = values.top();
+    values.pop();
+    fn->eraseFromParent();
+    return value ? value->getType() : nullptr;
+  };
+  
+  AstHasher hasher;
+  function.getBody().accept(hasher);
+  auto const& callees = hasher.getCallees();
+  if (std::find(callees.begin(), callees.end(), proto.getName()) == callees.end())
+    return generate();
+  
+  // Recursive calls need the return type before it's known. Assume the
+  // previous definition's return type, or Number, and generate the body
+  // again with the inferred type until it no longer changes. The errors of
+  // these attempts may be due to a wrong assumption, so they're only
+  // reported when the function is generated with the final type.
+  auto previous = fnReturnTypes.find(proto.getName());
+  llvm::Type* assumedType = previous != fnReturnTypes.end()
+    ? previous->second : llvm::Type::getDoubleTy(context);
+  std::ostringstream ignoredDiagnostics;
+  std::ostream* previousStream = diagnosticStream();
+  diagnosticStream() = &ignoredDiagnostics;
+  
+  for (unsigned attempt = 0; attempt < 4; ++attempt) {
+    fnReturnTypes[proto.getName()] = assumedReturnType = assumedType;
+    llvm::Type* type = generate();
+    if (!type || type == assumedType) break;
+    assumedType = type;
+  }
+  
+  assumedReturnType = nullptr;
+  diagnosticStream() = previousStream;
+  return assumedType;
+}
+
 void IrGen::visit(Function& function) {
   auto& proto = *function.getPrototype();
-  fnPrototypes[proto.getName()] = std::move(function.getPrototype());
+  // Copy the prototype so that the definition can be generated again later.
+  fnPrototypes[proto.getName()] = llvm::make_unique<Prototype>(proto);
+  initPGOState(function, proto.getName());
+  
+  // Keep the previous return type if the definition fails.
+  auto previous = fnReturnTypes.find(proto.getName());
+  llvm::Type* previousType = previous != fnReturnTypes.end() ? previous->second : nullptr;
+  auto restoreReturnType = [&] {
+    if (previousType) fnReturnTypes[proto.getName()] = previousType;
+    else fnReturnTypes.erase(proto.getName());
+  };
+  
+  PhaseTimer inferTimer("irgen: infer type", proto.getName());
+  llvm::Type* type = inferReturnType(function, proto);
+  inferTimer.stop();
+  if (!type) {
+    restoreReturnType();
+    return values.push(nullptr);
+  }
+  
+  returnType = type;
+  fnReturnTypes[proto.getName()] = returnType;
+  
+  // Generate the function with the inferred return type.
+  PhaseTimer irGenTimer("irgen", proto.getName());
   llvm::Function* fn = initFunction(function, proto);
   
   if (auto value = values.top()) {
     values.pop();
-    returnType = value->getType();
-    
-    // Recreate function with correct return type.
-    fn->eraseFromParent();
-    fn = initFunction(function, proto);
-    value = values.top();
-    values.pop();
+    if (value->getType() != type) {
+      fn->eraseFromParent();
+      restoreReturnType();
+      return values.push(error("couldn't infer the return type of '",
+                               proto.getName(), "'"));
+    }
     
+    if (profileCalls) createProfilerCalls(*fn, proto.getName());
+    if (keepFramePointers) fn->addFnAttr("no-frame-pointer-elim", "true");
+    if (auto entryCount = getPGOCount(0)) {
+      fn->setEntryCount(*entryCount);
+      if (*entryCount == 0) fn->addFnAttr(llvm::Attribute::Cold);
+    }
     builder.CreateRet(value);
     llvm::verifyFunction(*fn);
-    fnPassManager->run(*fn);
+    irGenTimer.stop();
+    if (fnPassManager) fnPassManager->run(*fn);
     values.push(fn);
     return;
   }
   
   // Error reading body, remove function.
   fn->eraseFromParent();
+  restoreReturnType();
+}
+
+llvm::Function* IrGen::createTupleWriter(llvm::Function& fn) {
+  auto tupleType = llvm::cast<llvm::StructType>(fn.getReturnType());
+  auto arrayType = llvm::Type::getDoublePtrTy(context);
+  auto writerType = llvm::FunctionType::get(builder.getVoidTy(), {arrayType}, false);
+  auto writer = llvm::Function::Create(writerType, llvm::Function::ExternalLinkage,
+                                       fn.getName() + ".values", module);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", writer));
+  
+  llvm::Value* tuple = builder.CreateCall(&fn, {}, "tuple");
+  llvm::Value* array = &*writer->arg_begin();
+  for (unsigned i = 0; i < tupleType->getNumElements(); ++i) {
+    llvm::Value* element = builder.CreateExtractValue(tuple, i);
+    if (element->getType()->isIntegerTy(1)) element = boolToDouble(element);
+    builder.CreateStore(element, builder.CreateConstGEP1_32(array, i));
+  }
+  
+  builder.CreateRetVoid();
+  llvm::verifyFunction(*writer);
+  if (fnPassManager) fnPassManager->run(*writer);
+  return writer;
+}
+
+void IrGen::createProfilerCalls(llvm::Function& fn, llvm::StringRef name) {
+  auto idType = builder.getInt32Ty();
+  auto idSlot = new llvm::GlobalVariable(*module, idType, false,
+                                         llvm::GlobalValue::PrivateLinkage,
+                                         builder.getInt32(~0u),
+                                         name + ".profile_id");
+  auto nameString = builder.CreateGlobalStringPtr(name, name + ".profile_name");
+  
+  auto enterType = llvm::FunctionType::get(
+    builder.getVoidTy(), {idType->getPointerTo(), builder.getInt8PtrTy()}, false);
+  auto exitType = llvm::FunctionType::get(builder.getVoidTy(), false);
+  auto enterFn = module->getOrInsertFunction(CallProfiler::enterFunctionName, enterType);
+  auto exitFn = module->getOrInsertFunction(CallProfiler::exitFunctionName, exitType);
+  
+  auto& entryBlock = fn.getEntryBlock();
+  llvm::IRBuilder<> entryBuilder(&entryBlock, entryBlock.getFirstInsertionPt());
+  entryBuilder.CreateCall(enterFn, {idSlot, nameString});
+  builder.CreateCall(exitFn, {});
 }
 
 llvm::AllocaInst* IrGen::createEntryBlockAlloca(llvm::Function* fn,
+                                                llvm::Type* type,
                                                 llvm::StringRef varName) {
   llvm::IRBuilder<> tmpBuilder(&fn->getEntryBlock(), fn->getEntryBlock().begin());
-  return tmpBuilder.CreateAlloca(llvm::Type::getDoubleTy(context), 0, varName);
+  return tmpBuilder.CreateAlloca(type, 0, varName);
+}
+
+void IrGen::importSignatures(IrGen const& other) {
+  for (auto const& entry : other.fnPrototypes) {
+    fnPrototypes[entry.first] = llvm::make_unique<Prototype>(*entry.second);
+  }
+  for (auto const& entry : other.fnReturnTypes) {
+    fnReturnTypes[entry.first] = importType(entry.second);
+  }
+}
+
+void IrGen::addSignature(Prototype const& proto, llvm::Type* returnType) {
+  fnPrototypes[proto.getName()] = llvm::make_unique<Prototype>(proto);
+  fnReturnTypes[proto.getName()] = returnType;
+}
+
+std::vector<std::pair<Prototype const*, llvm::Type*>> IrGen::getSignatures() const {
+  std::vector<std::pair<Prototype const*, llvm::Type*>> signatures;
+  for (auto const& entry : fnPrototypes) {
+    // Functions whose body failed to generate have no return type.
+    auto returnType = fnReturnTypes.find(entry.first);
+    if (returnType != fnReturnTypes.end()) {
+      signatures.push_back({entry.second.get(), returnType->second});
+    }
+  }
+  return signatures;
+}
+
+llvm::Type* IrGen::importType(llvm::Type* type) {
+  if (type->isIntegerTy(1))
+    return llvm::Type::getInt1Ty(context);
+  if (type->isDoubleTy())
+    return llvm::Type::getDoubleTy(context);
+  if (auto tupleType = llvm::dyn_cast<llvm::StructType>(type)) {
+    std::vector<llvm::Type*> elementTypes;
+    for (auto elementType : tupleType->elements()) {
+      elementTypes.push_back(importType(elementType));
+    }
+    return llvm::StructType::get(context, elementTypes);
+  }
+  fatalError("unknown type");
 }
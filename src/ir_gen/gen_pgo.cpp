@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <cstdint>
+#include <llvm/IR/MDBuilder.h>
+
+#include "ir_gen.h"
+#include "../ast/ast_hasher.h"
+#include "../ast/function.h"
+#include "../util/pgo_profile.h"
+
+using namespace eax;
+
+void IrGen::initPGOState(Function& function, llvm::StringRef name) {
+  pgoFunction.clear();
+  pgoCounts = nullptr;
+  nextPGOCounter = 0;
+  // Top-level expressions are compiled for a single evaluation, so there's
+  // nothing to gain from profiling them.
+  if ((!pgoInstrument && !pgoProfile) || name == "__anon_expr") return;
+  
+  AstHasher hasher;
+  function.accept(hasher);
+  pgoFunction = name;
+  pgoChecksum = hasher.getHash();
+  if (pgoProfile) pgoCounts = pgoProfile->lookup(pgoFunction, pgoChecksum);
+}
+
+void IrGen::createPGOIncrement(unsigned index) {
+  if (!pgoInstrument || pgoFunction.empty()) return;
+  
+  auto counter = ProfileCounters::get().getCounter(pgoFunction, pgoChecksum, index);
+  auto counterType = builder.getInt64Ty();
+  auto address = builder.CreateIntToPtr(builder.getInt64(uintptr_t(counter)),
+                                        counterType->getPointerTo(), "pgocounter");
+  auto count = builder.CreateLoad(address, "pgocount");
+  builder.CreateStore(builder.CreateAdd(count, builder.getInt64(1)), address);
+}
+
+uint64_t const* IrGen::getPGOCount(unsigned index) const {
+  if (!pgoCounts || index >= pgoCounts->size()) return nullptr;
+  return &(*pgoCounts)[index];
+}
+
+llvm::MDNode* IrGen::createBranchWeights(uint64_t trueCount, uint64_t falseCount) {
+  // Branch weights are 32-bit, so large counts are scaled down. Adding 1
+  // keeps a branch that wasn't taken during profiling from being treated as
+  // unreachable.
+  uint64_t scale = std::max(trueCount, falseCount) / UINT32_MAX + 1;
+  return llvm::MDBuilder(context).createBranchWeights(uint32_t(trueCount / scale + 1),
+                                                      uint32_t(falseCount / scale + 1));
+}
@@ -9,7 +9,12 @@ void IrGen::visit(Prototype& proto) {
   std::vector<llvm::Type*> doubles(proto.getParamNames().size(),
     llvm::Type::getDoubleTy(context));
   
-  auto fnType = llvm::FunctionType::get(returnType, doubles, false);
+  // Use the return type inferred from the function's body, if it has been
+  // generated already.
+  auto returnTypeIter = fnReturnTypes.find(proto.getName());
+  auto fnType = llvm::FunctionType::get(
+    returnTypeIter != fnReturnTypes.end() ? returnTypeIter->second : returnType,
+    doubles, false);
   
   auto fn = llvm::Function::Create(fnType,
                                    llvm::Function::ExternalLinkage,
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <functional>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringRef.h>
+
+#include "ir_gen.h"
+#include "../ast/expr.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+namespace {
+
+/// Adds up the cost of evaluating the visited expressions unconditionally.
+/// Divisions are counted as several operations, and anything that must not
+/// be evaluated speculatively makes the cost unbounded.
+class SpeculationCost : public AstVisitor {
+public:
+  /// "getCallCost" returns the cost of calling a function, or None if it
+  /// must not be called speculatively.
+  using CallCostFn = std::function<llvm::Optional<unsigned>(llvm::StringRef)>;
+  
+  SpeculationCost(CallCostFn getCallCost) : getCallCost(std::move(getCallCost)) {}
+  bool isBounded() const { return bounded; }
+  unsigned getCost() const { return cost; }
+  
+private:
+  void visit(VariableExpr&) override {}
+  void visit(NumberExpr&) override {}
+  void visit(BoolExpr&) override {}
+  
+  void visit(UnaryExpr& expr) override {
+    cost += 1;
+    expr.getOperand().accept(*this);
+  }
+  
+  void visit(BinaryExpr& expr) override {
+    switch (expr.getOp()) {
+    case '=': bounded = false; return; // Has a side effect.
+    case '/': cost += 4; break;
+    default: cost += 1; break;
+    }
+    expr.getLhs().accept(*this);
+    expr.getRhs().accept(*this);
+  }
+  
+  void visit(CallExpr& expr) override {
+    auto callCost = getCallCost(expr.getName());
+    if (!callCost) {
+      bounded = false;
+      return;
+    }
+    cost += *callCost;
+    for (auto const& arg : expr.getArgs()) arg->accept(*this);
+  }
+  
+  void visit(IfExpr& expr) override {
+    cost += 1; // For the select.
+    expr.getCondition().accept(*this);
+    expr.getThen().accept(*this);
+    expr.getElse().accept(*this);
+  }
+  
+  void visit(TupleExpr& expr) override {
+    for (auto const& element : expr.getElements()) element->accept(*this);
+  }
+  
+  void visit(LetExpr& expr) override {
+    expr.getValue().accept(*this);
+    expr.getBody().accept(*this);
+  }
+  
+  void visit(Function&) override { bounded = false; }
+  void visit(Prototype&) override { bounded = false; }
+  
+private:
+  CallCostFn getCallCost;
+  unsigned cost = 0;
+  bool bounded = true;
+};
+
+}
+
+unsigned IrGen::getSpeculationCost(Expr& expr) const {
+  SpeculationCost visitor([this](llvm::StringRef name) -> llvm::Optional<unsigned> {
+    // User functions may be expensive, recurse, or not terminate at all. They
+    // shadow the builtins.
+    if (fnPrototypes.count(name) || module->getFunction(name) || !isBuiltin(name))
+      return llvm::None;
+    return getBuiltinCost(name);
+  });
+  expr.accept(visitor);
+  if (!visitor.isBounded()) return maxSpeculationCost + 1;
+  return std::min(visitor.getCost(), maxSpeculationCost + 1);
+}
+
+void IrGen::codegenSelect(IfExpr& expr, llvm::Value* condition) {
+  expr.getThen().accept(*this);
+  llvm::Value* thenValue = values.top();
+  if (!thenValue) return;
+  values.pop();
+  
+  expr.getElse().accept(*this);
+  llvm::Value* elseValue = values.top();
+  if (!elseValue) return;
+  values.pop();
+  
+  if (thenValue->getType() != elseValue->getType())
+    return values.push(error("the branches of 'if' must have the same type"));
+  
+  // The code generator lowers selects of compared values to min/max and
+  // blend instructions where it can.
+  values.push(builder.CreateSelect(condition, thenValue, elseValue, "iftmp"));
+}
+
+void IrGen::codegenLogicalOperator(BinaryExpr& expr) {
+  bool isAnd = expr.getOp() == '&&';
+  char const* opName = isAnd ? "&&" : "||";
+  llvm::Type* boolType = llvm::Type::getInt1Ty(context);
+  
+  // Pops the value of an operand, or returns null if it failed or isn't a
+  // Bool. While the return type of a recursive function is being inferred,
+  // that may only be because a recursive call has the wrong type, and the
+  // result is a Bool either way, so an undefined Bool is used instead.
+  auto popOperand = [&]() -> llvm::Value* {
+    llvm::Value* value = values.top();
+    values.pop();
+    if (value && value->getType() == boolType) return value;
+    if (assumedReturnType) return llvm::UndefValue::get(boolType);
+    if (value) error("'", opName, "' requires Bool operands");
+    return nullptr;
+  };
+  
+  expr.getLhs().accept(*this);
+  llvm::Value* left = popOperand();
+  if (!left) return values.push(nullptr);
+  
+  // A cheap rhs without side effects is evaluated unconditionally, like the
+  // branches of an if expression.
+  if (getSpeculationCost(expr.getRhs()) <= maxSpeculationCost) {
+    expr.getRhs().accept(*this);
+    llvm::Value* right = popOperand();
+    if (!right) return values.push(nullptr);
+    
+    if (isAnd) return values.push(builder.CreateAnd(left, right, "andtmp"));
+    return values.push(builder.CreateOr(left, right, "ortmp"));
+  }
+  
+  // Otherwise the rhs is only evaluated if the lhs doesn't decide the result.
+  llvm::Function* fn = builder.GetInsertBlock()->getParent();
+  llvm::BasicBlock* leftBlock = builder.GetInsertBlock();
+  llvm::BasicBlock* rightBlock = llvm::BasicBlock::Create(
+    context, isAnd ? "andrhs" : "orrhs", fn);
+  llvm::BasicBlock* mergeBlock = llvm::BasicBlock::Create(
+    context, isAnd ? "andcont" : "orcont");
+  if (isAnd) builder.CreateCondBr(left, rightBlock, mergeBlock);
+  else builder.CreateCondBr(left, mergeBlock, rightBlock);
+  
+  builder.SetInsertPoint(rightBlock);
+  expr.getRhs().accept(*this);
+  llvm::Value* right = popOperand();
+  if (!right) return values.push(nullptr);
+  
+  builder.CreateBr(mergeBlock);
+  rightBlock = builder.GetInsertBlock();
+  
+  fn->getBasicBlockList().push_back(mergeBlock);
+  builder.SetInsertPoint(mergeBlock);
+  llvm::PHINode* phi = builder.CreatePHI(boolType, 2, isAnd ? "andtmp" : "ortmp");
+  phi->addIncoming(builder.getInt1(!isAnd), leftBlock);
+  phi->addIncoming(right, rightBlock);
+  values.push(phi);
+}
@@ -4,6 +4,8 @@
 #include <stack>
 #include <memory>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
@@ -16,15 +18,70 @@
 
 namespace eax {
 
+class Expr;
+class Profile;
+
 class IrGen : public AstVisitor {
 public:
   IrGen(llvm::LLVMContext& context) : context(context), builder(context) {}
   llvm::Value* getResult() const { return values.top(); }
+  llvm::LLVMContext& getContext() const { return context; }
   void setModule(llvm::Module& module) { this->module = &module; }
-  void setFnPassManager(llvm::legacy::FunctionPassManager& fpm) {
-    fnPassManager = &fpm;
+  
+  /// Sets the passes to run on each generated function, or null to leave
+  /// the functions unoptimized.
+  void setFnPassManager(llvm::legacy::FunctionPassManager* fpm) {
+    fnPassManager = fpm;
+  }
+  llvm::FastMathFlags getFastMathFlags() const {
+    return builder.getFastMathFlags();
+  }
+  void setFastMathFlags(llvm::FastMathFlags flags) {
+    builder.setFastMathFlags(flags);
   }
   
+  /// Sets whether to count the calls of the generated functions and the
+  /// cycles spent in them (see CallProfiler).
+  void setProfileCalls(bool profileCalls) { this->profileCalls = profileCalls; }
+  bool getProfileCalls() const { return profileCalls; }
+  
+  /// Sets whether the generated functions keep a frame pointer, so that a
+  /// sampling profiler can walk their call stacks.
+  void setKeepFramePointers(bool keep) { keepFramePointers = keep; }
+  bool getKeepFramePointers() const { return keepFramePointers; }
+  
+  /// Sets whether the generated functions count how often they're called
+  /// and which way their if expressions branch (see ProfileCounters).
+  void setPGOInstrument(bool instrument) { pgoInstrument = instrument; }
+  bool getPGOInstrument() const { return pgoInstrument; }
+  
+  /// Sets the profile to take branch weights and function entry counts
+  /// from, or null to generate code without one. The profile must outlive
+  /// the IrGen.
+  void setPGOProfile(Profile const* profile) { pgoProfile = profile; }
+  Profile const* getPGOProfile() const { return pgoProfile; }
+  
+  /// Makes the functions known to "other", which may use a different
+  /// LLVMContext, callable from code generated by this IrGen.
+  void importSignatures(IrGen const& other);
+  
+  /// Makes a function that has been compiled elsewhere, e.g. loaded from a
+  /// snapshot, callable from code generated by this IrGen.
+  void addSignature(Prototype const& proto, llvm::Type* returnType);
+  
+  /// Returns the prototypes and return types of the functions known to this
+  /// IrGen, in no particular order.
+  std::vector<std::pair<Prototype const*, llvm::Type*>> getSignatures() const;
+  
+  /// Returns the number of function prototypes known to this IrGen.
+  size_t getNumPrototypes() const { return fnPrototypes.size(); }
+  
+  /// Generates a function "<name>.values" that calls "fn", which takes no
+  /// arguments and returns a tuple, and stores the tuple's elements to the
+  /// array of doubles it's passed, Bools as 0 or 1. This gives tuples an ABI
+  /// that C++ code can call.
+  llvm::Function* createTupleWriter(llvm::Function& fn);
+  
 private:
   void visit(VariableExpr&) override;
   void visit(UnaryExpr&) override;
@@ -33,6 +90,8 @@ private:
   void visit(NumberExpr&) override;
   void visit(BoolExpr&) override;
   void visit(IfExpr&) override;
+  void visit(TupleExpr&) override;
+  void visit(LetExpr&) override;
   void visit(Function&) override;
   void visit(Prototype&) override;
   
@@ -42,8 +101,65 @@ private:
   llvm::Value* createEqualityComparison(llvm::Value* lhs, llvm::Value* rhs);
   llvm::Value* createInequalityComparison(llvm::Value* lhs, llvm::Value* rhs);
   void codegenAssignment(BinaryExpr&);
+  void codegenLogicalOperator(BinaryExpr&);
+  
+  /// Generates "expr" as a select between its branches, which are both
+  /// evaluated in the current block.
+  void codegenSelect(IfExpr& expr, llvm::Value* condition);
+  
+  /// Returns the estimated cost of evaluating "expr" unconditionally, in
+  /// simple operations, capped at maxSpeculationCost + 1. Expressions with
+  /// side effects or calls of user functions are never evaluated
+  /// speculatively, so they cost more than maxSpeculationCost.
+  unsigned getSpeculationCost(Expr& expr) const;
+  
+  /// The cost up to which the branches of an if expression, or the rhs of
+  /// '&&' or '||', are evaluated unconditionally instead of branching.
+  static unsigned const maxSpeculationCost = 8;
+  
+  /// Returns whether "name" refers to a function in the builtin math library.
+  static bool isBuiltin(llvm::StringRef name);
+  
+  /// Returns the estimated cost of a builtin math function in simple
+  /// operations, for getSpeculationCost().
+  static unsigned getBuiltinCost(llvm::StringRef name);
+  
+  /// Emits a call to a builtin math function as an LLVM intrinsic, so that
+  /// the optimizer can inline, constant-fold and vectorize it.
+  void codegenBuiltinCall(CallExpr&);
+  
   void createParamAllocas(Prototype const&, llvm::Function*);
   llvm::Function* initFunction(Function&, Prototype&);
+  llvm::Type* inferReturnType(Function&, Prototype&);
+  
+  /// Adds calls to the CallProfiler at the start of "fn" and at the current
+  /// insertion point, which must be where "fn" returns.
+  void createProfilerCalls(llvm::Function& fn, llvm::StringRef name);
+  
+  /// Prepares the PGO state for generating "function", which has the given
+  /// name.
+  void initPGOState(Function& function, llvm::StringRef name);
+  
+  /// Reserves "count" consecutive PGO counters in the current function, and
+  /// returns the index of the first.
+  unsigned reservePGOCounters(unsigned count) {
+    unsigned index = nextPGOCounter;
+    nextPGOCounter += count;
+    return index;
+  }
+  
+  /// Increments a PGO counter of the current function, if instrumenting.
+  void createPGOIncrement(unsigned index);
+  
+  /// Returns the profiled count of a counter of the current function, or
+  /// null if there's no profile for it.
+  uint64_t const* getPGOCount(unsigned index) const;
+  
+  /// Returns branch weights for the given profiled counts.
+  llvm::MDNode* createBranchWeights(uint64_t trueCount, uint64_t falseCount);
+  
+  /// Returns the type corresponding to "type" in this IrGen's LLVMContext.
+  llvm::Type* importType(llvm::Type* type);
   
   /// Searches "module" for an existing function declaration with the given
   /// name, or, if it doesn't find one, generates a new one from "fnPrototypes".
@@ -51,9 +167,9 @@ private:
   
   /// Creates an "alloca" instruction in the entry block of the given
   /// function. This is used for mutable variables etc.
-  llvm::AllocaInst* createEntryBlockAlloca(llvm::Function* fn,
+  llvm::AllocaInst* createEntryBlockAlloca(llvm::Function* fn, llvm::Type* type,
                                            llvm::StringRef varName);
-
+  
 private:
   llvm::LLVMContext& context;
   llvm::IRBuilder<> builder;
@@ -61,8 +177,23 @@ private:
   llvm::legacy::FunctionPassManager* fnPassManager;
   std::unordered_map<std::string, llvm::AllocaInst*> namedValues;
   std::unordered_map<std::string, std::unique_ptr<Prototype>> fnPrototypes;
+  std::unordered_map<std::string, llvm::Type*> fnReturnTypes;
   std::stack<llvm::Value*> values;
   llvm::Type* returnType = llvm::Type::getVoidTy(context); // Dummy initial value
+  
+  /// The return type assumed for recursive calls while inferring the return
+  /// type of a recursive function, or null.
+  llvm::Type* assumedReturnType = nullptr;
+  bool profileCalls = false;
+  bool keepFramePointers = false;
+  bool pgoInstrument = false;
+  Profile const* pgoProfile = nullptr;
+  
+  // The PGO state of the function being generated.
+  std::string pgoFunction; // Empty if the function isn't instrumented or profiled.
+  uint64_t pgoChecksum = 0;
+  std::vector<uint64_t> const* pgoCounts = nullptr; // Null if there's no profile for it.
+  unsigned nextPGOCounter = 0;
 };
 
 }
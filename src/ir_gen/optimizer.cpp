@@ -0,0 +1,122 @@
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Vectorize.h>
+
+#include "optimizer.h"
+#include "../util/timings.h"
+
+using namespace eax;
+
+namespace {
+
+/// Adds the time since the previous marker to the pass that precedes it in
+/// the pipeline, including the analyses that pass required. Markers are only
+/// inserted when the timings are enabled, and change nothing.
+class PassTimerMarker : public llvm::FunctionPass {
+public:
+  static char ID;
+  
+  PassTimerMarker(std::shared_ptr<Timings::Clock::time_point> lastTime,
+                  std::string phase)
+    : FunctionPass(ID), lastTime(std::move(lastTime)), phase(std::move(phase)) {}
+  
+  bool runOnFunction(llvm::Function& fn) override {
+    auto now = Timings::Clock::now();
+    if (!phase.empty()) Timings::get().add(fn.getName(), phase, now - *lastTime);
+    *lastTime = now;
+    return false;
+  }
+  
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+    usage.setPreservesAll();
+  }
+  
+private:
+  std::shared_ptr<Timings::Clock::time_point> lastTime;
+  std::string phase;
+};
+
+char PassTimerMarker::ID = 0;
+
+/// Records the size of the function after the pass that precedes it in the
+/// pipeline.
+class PassStatisticsMarker : public llvm::FunctionPass {
+public:
+  static char ID;
+  
+  PassStatisticsMarker(PassStatistics& statistics, std::string pass)
+    : FunctionPass(ID), statistics(statistics), pass(std::move(pass)) {}
+  
+  bool runOnFunction(llvm::Function& fn) override {
+    unsigned instructions = 0;
+    for (auto& basicBlock : fn) instructions += basicBlock.size();
+    statistics.entries.push_back({pass, unsigned(fn.size()), instructions});
+    return false;
+  }
+  
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const override {
+    usage.setPreservesAll();
+  }
+  
+private:
+  PassStatistics& statistics;
+  std::string pass;
+};
+
+char PassStatisticsMarker::ID = 0;
+
+/// Adds passes to a pass manager, followed by timer markers if the timings
+/// are enabled, and statistics markers if statistics are requested.
+class PassAdder {
+public:
+  PassAdder(llvm::legacy::FunctionPassManager& fnPassManager,
+            PassStatistics* statistics)
+    : fnPassManager(fnPassManager), timed(Timings::get().isEnabled()),
+      lastTime(std::make_shared<Timings::Clock::time_point>()),
+      statistics(statistics) {
+    if (timed) fnPassManager.add(new PassTimerMarker(lastTime, ""));
+    if (statistics) fnPassManager.add(new PassStatisticsMarker(*statistics, "input"));
+  }
+  
+  void add(llvm::Pass* pass) {
+    std::string passName(pass->getPassName());
+    fnPassManager.add(pass);
+    if (timed) fnPassManager.add(new PassTimerMarker(lastTime, "pass: " + passName));
+    if (statistics) fnPassManager.add(new PassStatisticsMarker(*statistics, passName));
+  }
+  
+private:
+  llvm::legacy::FunctionPassManager& fnPassManager;
+  bool timed;
+  std::shared_ptr<Timings::Clock::time_point> lastTime;
+  PassStatistics* statistics;
+};
+
+}
+
+std::unique_ptr<llvm::legacy::FunctionPassManager>
+eax::createFnPassManager(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                         PassStatistics* statistics) {
+  auto fnPassManager = llvm::make_unique<llvm::legacy::FunctionPassManager>(&module);
+  // Let the passes query the target's costs, e.g. for vector instructions.
+  fnPassManager->add(llvm::createTargetTransformInfoWrapperPass(
+    targetMachine.getTargetIRAnalysis()));
+  PassAdder passes(*fnPassManager, statistics);
+  // Promote allocas to registers.
+  passes.add(llvm::createPromoteMemoryToRegisterPass());
+  // Do simple "peephole" and bit-twiddling  optimizations.
+  passes.add(llvm::createInstructionCombiningPass());
+  // Reassociate expressions.
+  passes.add(llvm::createReassociatePass());
+  // Eliminate common subexpressions.
+  passes.add(llvm::createGVNPass());
+  // Combine independent scalar operations, e.g. builtin math calls, into
+  // vector operations.
+  passes.add(llvm::createSLPVectorizerPass());
+  // Simplify the control flow graph (deleting unreachable blocks, etc.).
+  passes.add(llvm::createCFGSimplificationPass());
+  fnPassManager->doInitialization();
+  return fnPassManager;
+}
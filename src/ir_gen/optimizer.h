@@ -0,0 +1,34 @@
+#ifndef EAX_OPTIMIZER_H
+#define EAX_OPTIMIZER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+namespace eax {
+
+/// The size of a function after each pass of the pipeline, preceded by its
+/// size before the first pass.
+struct PassStatistics {
+  struct Entry {
+    std::string pass;
+    unsigned basicBlocks;
+    unsigned instructions;
+  };
+  
+  std::vector<Entry> entries;
+};
+
+/// Creates the pass pipeline that IrGen runs on each function it generates
+/// into "module", using the given target's cost model. If "statistics" is
+/// given, the pipeline records the size of each function it runs on there.
+std::unique_ptr<llvm::legacy::FunctionPassManager>
+createFnPassManager(llvm::Module& module, llvm::TargetMachine& targetMachine,
+                    PassStatistics* statistics = nullptr);
+
+}
+
+#endif
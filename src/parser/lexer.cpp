@@ -12,16 +12,18 @@ using namespace eax;
 
 Lexer::Lexer() {
   binaryOperatorPrecedence['='] = 1;
-  binaryOperatorPrecedence['=='] = 2;
-  binaryOperatorPrecedence['!='] = 2;
-  binaryOperatorPrecedence['<'] = 3;
-  binaryOperatorPrecedence['>'] = 3;
-  binaryOperatorPrecedence['<='] = 3;
-  binaryOperatorPrecedence['>='] = 3;
-  binaryOperatorPrecedence['+'] = 4;
-  binaryOperatorPrecedence['-'] = 4;
-  binaryOperatorPrecedence['*'] = 5;
-  binaryOperatorPrecedence['/'] = 5;
+  binaryOperatorPrecedence['||'] = 2;
+  binaryOperatorPrecedence['&&'] = 3;
+  binaryOperatorPrecedence['=='] = 4;
+  binaryOperatorPrecedence['!='] = 4;
+  binaryOperatorPrecedence['<'] = 5;
+  binaryOperatorPrecedence['>'] = 5;
+  binaryOperatorPrecedence['<='] = 5;
+  binaryOperatorPrecedence['>='] = 5;
+  binaryOperatorPrecedence['+'] = 6;
+  binaryOperatorPrecedence['-'] = 6;
+  binaryOperatorPrecedence['*'] = 7;
+  binaryOperatorPrecedence['/'] = 7;
   
   idToTokenMap["def"] = TokenDef;
   idToTokenMap["if"] = TokenIf;
@@ -29,6 +31,8 @@ Lexer::Lexer() {
   idToTokenMap["else"] = TokenElse;
   idToTokenMap["true"] = TokenTrue;
   idToTokenMap["false"] = TokenFalse;
+  idToTokenMap["let"] = TokenLet;
+  idToTokenMap["in"] = TokenIn;
 }
 
 int Lexer::getToken() {
@@ -99,6 +103,22 @@ int Lexer::getToken() {
       unreadChar(ch);
   }
   
+  if (lastChar == '&') {
+    int ch = readChar();
+    if (ch == '&')
+      return '&&';
+    else
+      unreadChar(ch);
+  }
+  
+  if (lastChar == '|') {
+    int ch = readChar();
+    if (ch == '|')
+      return '||';
+    else
+      unreadChar(ch);
+  }
+  
   if (lastChar == '#') {
     do {
       lastChar = readChar();
@@ -132,11 +152,30 @@ std::unique_ptr<Expr> Lexer::parseParenExpr() {
   nextToken(); // consume '('
   auto value = parseExpr();
   if (!value) return nullptr;
+  if (currentToken == ',') return parseTupleExpr(std::move(value));
   if (currentToken != ')') return error("expected ')'");
   nextToken(); // consume ')'
   return value;
 }
 
+std::unique_ptr<Expr> Lexer::parseTupleExpr(std::unique_ptr<Expr> firstElement) {
+  std::vector<std::unique_ptr<Expr>> elements;
+  elements.push_back(std::move(firstElement));
+  
+  while (currentToken == ',') {
+    nextToken(); // consume ','
+    if (auto element = parseExpr()) {
+      elements.push_back(std::move(element));
+    } else {
+      return nullptr;
+    }
+  }
+  
+  if (currentToken != ')') return error("expected ')' or ',' in tuple");
+  nextToken(); // consume ')'
+  return llvm::make_unique<TupleExpr>(std::move(elements));
+}
+
 std::unique_ptr<Expr> Lexer::parseIdentifierExpr() {
   std::string idName = std::move(identifierValue);
   
@@ -184,6 +223,7 @@ std::unique_ptr<Expr> Lexer::parsePrimaryExpr() {
     case TokenTrue: eax_fallthrough;
     case TokenFalse: return parseBoolExpr();
     case TokenIf: return parseIfExpr();
+    case TokenLet: return parseLetExpr();
     case '(': return parseParenExpr();
     default:
       unknownTokenError(currentToken);
@@ -264,6 +304,44 @@ std::unique_ptr<Expr> Lexer::parseIfExpr() {
                                    std::move(elseBranch));
 }
 
+std::unique_ptr<Expr> Lexer::parseLetExpr() {
+  nextToken(); // consume 'let'
+  
+  std::vector<std::string> names;
+  bool destructuring = currentToken == '(';
+  if (destructuring) {
+    while (nextToken() == TokenIdentifier) {
+      names.push_back(std::move(identifierValue));
+      
+      if (nextToken() != ',')
+        break;
+    }
+    
+    if (currentToken != ')' || names.empty()) {
+      return error("expected a name, ',' or ')' in 'let'");
+    }
+  } else if (currentToken == TokenIdentifier) {
+    names.push_back(std::move(identifierValue));
+  } else {
+    return error("expected a name or '(' after 'let'");
+  }
+  
+  if (nextToken() != '=') return error("expected '=' in 'let'");
+  nextToken();
+  
+  auto value = parseExpr();
+  if (!value) return nullptr;
+  
+  if (currentToken != TokenIn) return error("expected 'in' in 'let'");
+  nextToken();
+  
+  auto body = parseExpr();
+  if (!body) return nullptr;
+  
+  return llvm::make_unique<LetExpr>(std::move(names), destructuring,
+                                    std::move(value), std::move(body));
+}
+
 std::unique_ptr<Prototype> Lexer::parseFnPrototype() {
   if (currentToken != TokenIdentifier) {
     return error("expected function name in prototype");
@@ -316,6 +394,16 @@ std::unique_ptr<Function> Lexer::parseToplevelExpr() {
   return nullptr;
 }
 
+std::string Lexer::readLine() {
+  std::string line;
+  int ch;
+  do {
+    ch = readChar();
+    if (ch != EOF) line += ch;
+  } while (ch != EOF && ch != '\n');
+  return line;
+}
+
 int Lexer::getTokenPrecedence(int token) const {
   auto iterator = binaryOperatorPrecedence.find(token);
   if (iterator != binaryOperatorPrecedence.end()) {
@@ -23,44 +23,76 @@ enum Token {
   TokenThen = -6,
   TokenElse = -7,
   TokenTrue = -8,
-  TokenFalse = -9
+  TokenFalse = -9,
+  TokenLet = -10,
+  TokenIn = -11
 };
 
 class Lexer {
 public:
   Lexer();
   
+  /// Sets the input source, which is stdin by default.
+  void setInput(std::FILE* input) { this->input = input; }
+  
+  /// Sets an in-memory input source, which must outlive the lexer's use of it.
+  void setInput(llvm::StringRef source) {
+    input = nullptr;
+    this->source = source;
+    position = 0;
+  }
+  
   /// Updates CurrentToken with the next token and returns it.
   int nextToken() { return currentToken = getToken(); }
   
+  int getCurrentToken() const { return currentToken; }
+  std::string const& getIdentifier() const { return identifierValue; }
+  double getNumber() const { return numberValue; }
+  
   std::unique_ptr<Function> parseToplevelExpr();
   std::unique_ptr<Function> parseFnDefinition();
   
+  /// Returns the rest of the current line without tokenizing it, including
+  /// the newline character.
+  std::string readLine();
+  
 private:
   /// Returns the next token from the input source.
   int getToken();
   
   /// Returns the next character from the input source.
-  int readChar() const { return std::getchar(); }
+  int readChar() {
+    if (input) return std::getc(input);
+    if (position == source.size()) return EOF;
+    return static_cast<unsigned char>(source[position++]);
+  }
   
   /// Puts a character back to the input source, so that the next call
   /// to readChar() will return that character.
-  void unreadChar(int ch) const { std::ungetc(ch, stdin); }
+  void unreadChar(int ch) {
+    if (input) std::ungetc(ch, input);
+    else if (ch != EOF) --position;
+  }
   
   std::unique_ptr<Expr> parseNumberExpr();
   std::unique_ptr<Expr> parseBoolExpr();
   std::unique_ptr<Expr> parseParenExpr();
+  std::unique_ptr<Expr> parseTupleExpr(std::unique_ptr<Expr> firstElement);
   std::unique_ptr<Expr> parseIdentifierExpr();
   std::unique_ptr<Expr> parsePrimaryExpr();
   std::unique_ptr<Expr> parseExpr();
   std::unique_ptr<Expr> parseUnaryExpr();
   std::unique_ptr<Expr> parseBinOpRHS(int exprPrecedence, std::unique_ptr<Expr> lhs);
   std::unique_ptr<Expr> parseIfExpr();
+  std::unique_ptr<Expr> parseLetExpr();
   std::unique_ptr<Prototype> parseFnPrototype();
   
   int getTokenPrecedence(int token) const;
   
 private:
+  std::FILE* input = stdin; // Null if reading from "source".
+  llvm::StringRef source;
+  size_t position = 0;
   int currentToken;
   std::string identifierValue; // Filled in if TokenIdentifier.
   double numberValue; // Filled in if TokenNumber.
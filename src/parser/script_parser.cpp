@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#include "script_parser.h"
+#include "lexer.h"
+#include "../util/error.h"
+#include "../util/timings.h"
+
+using namespace eax;
+
+/// Returns whether "line" starts a definition, i.e. whether its first token
+/// is "def".
+static bool startsDefinition(llvm::StringRef line) {
+  line = line.ltrim(" \t");
+  return line.startswith("def") &&
+         (line.size() == 3 || !std::isalnum(static_cast<unsigned char>(line[3])));
+}
+
+/// Returns the offsets at which the source can be split into chunks that
+/// parse the same on their own as they do as part of the whole source.
+/// These are the starts of lines that begin a definition, except after a
+/// line with a comment: the lexer skips a comment along with the newline
+/// that ends it, joining the lines.
+static std::vector<size_t> findDefinitionBoundaries(llvm::StringRef source) {
+  std::vector<size_t> boundaries;
+  bool previousLineHasComment = false;
+  
+  for (size_t lineBegin = 0; lineBegin < source.size();) {
+    size_t lineEnd = source.find('\n', lineBegin);
+    if (lineEnd == llvm::StringRef::npos) lineEnd = source.size();
+    llvm::StringRef line = source.slice(lineBegin, lineEnd);
+    
+    if (lineBegin > 0 && !previousLineHasComment && startsDefinition(line)) {
+      boundaries.push_back(lineBegin);
+    }
+    
+    previousLineHasComment = line.find('#') != llvm::StringRef::npos;
+    lineBegin = lineEnd + 1;
+  }
+  
+  return boundaries;
+}
+
+/// Splits the source into about "numChunks" chunks of similar size.
+static std::vector<llvm::StringRef> splitIntoChunks(llvm::StringRef source,
+                                                    size_t numChunks) {
+  std::vector<llvm::StringRef> chunks;
+  size_t targetSize = source.size() / std::max(numChunks, size_t(1)) + 1;
+  size_t chunkBegin = 0;
+  
+  for (size_t boundary : findDefinitionBoundaries(source)) {
+    if (boundary - chunkBegin >= targetSize) {
+      chunks.push_back(source.slice(chunkBegin, boundary));
+      chunkBegin = boundary;
+    }
+  }
+  
+  chunks.push_back(source.substr(chunkBegin));
+  return chunks;
+}
+
+static std::vector<ScriptItem> parseChunk(llvm::StringRef chunk) {
+  std::vector<ScriptItem> items;
+  Lexer lexer;
+  lexer.setInput(chunk);
+  
+  // Collect the diagnostics of each item separately, so that they can be
+  // reported in source order along with the results of the other items.
+  std::ostringstream diagnostics;
+  std::ostream* previousStream = diagnosticStream();
+  diagnosticStream() = &diagnostics;
+  
+  while (true) {
+    ScriptItem item;
+    PhaseTimer timer("parse");
+    
+    switch (lexer.nextToken()) {
+    case TokenEof:
+      diagnosticStream() = previousStream;
+      return items;
+    case '\n':
+      continue;
+    case TokenDef:
+      item.fn = lexer.parseFnDefinition();
+      item.kind = item.fn ? ScriptItem::Definition : ScriptItem::Invalid;
+      break;
+    case ':':
+      item.kind = ScriptItem::Command;
+      item.command = lexer.readLine();
+      break;
+    default:
+      item.fn = lexer.parseToplevelExpr();
+      item.kind = item.fn ? ScriptItem::Expression : ScriptItem::Invalid;
+      break;
+    }
+    
+    if (item.kind == ScriptItem::Invalid) {
+      lexer.nextToken(); // Skip token for error recovery.
+    }
+    if (item.fn) timer.setDefinition(item.fn->getPrototype()->getName());
+    
+    item.diagnostics = diagnostics.str();
+    diagnostics.str("");
+    items.push_back(std::move(item));
+  }
+}
+
+std::vector<ScriptItem> eax::parseScript(llvm::StringRef source,
+                                         unsigned numThreads) {
+  // Don't start threads for a single chunk.
+  if (numThreads <= 1) return parseChunk(source);
+  
+  // Make more chunks than threads, so that the work stays balanced even if
+  // some chunks take longer to parse than others.
+  auto chunks = splitIntoChunks(source, numThreads * 4);
+  if (chunks.size() == 1) return parseChunk(chunks[0]);
+  
+  std::vector<std::vector<ScriptItem>> chunkItems(chunks.size());
+  
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  
+  for (size_t i = 0; i < std::min(size_t(numThreads), chunks.size()); ++i) {
+    threads.emplace_back([&] {
+      for (size_t j; (j = next++) < chunks.size();) {
+        chunkItems[j] = parseChunk(chunks[j]);
+      }
+    });
+  }
+  
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  
+  std::vector<ScriptItem> items;
+  for (auto& itemsOfChunk : chunkItems) {
+    std::move(itemsOfChunk.begin(), itemsOfChunk.end(), std::back_inserter(items));
+  }
+  return items;
+}
@@ -0,0 +1,31 @@
+#ifndef EAX_SCRIPT_PARSER_H
+#define EAX_SCRIPT_PARSER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+#include "../ast/function.h"
+
+namespace eax {
+
+/// A top-level item of a script, along with the diagnostics reported while
+/// parsing it.
+struct ScriptItem {
+  enum Kind { Definition, Expression, Command, Invalid };
+  
+  Kind kind;
+  std::unique_ptr<Function> fn; // For definitions and expressions.
+  std::string command; // The rest of the line after ':' for commands.
+  std::string diagnostics;
+};
+
+/// Parses a whole script into its top-level items, in source order. The
+/// source is split at definition boundaries into chunks that are lexed and
+/// parsed concurrently on up to "numThreads" threads.
+std::vector<ScriptItem> parseScript(llvm::StringRef source, unsigned numThreads);
+
+}
+
+#endif
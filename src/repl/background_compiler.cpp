@@ -0,0 +1,88 @@
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "background_compiler.h"
+#include "../ir_gen/optimizer.h"
+#include "../util/error.h"
+#include "../util/metrics.h"
+#include "../util/timings.h"
+
+using namespace eax;
+
+BackgroundCompiler::BackgroundCompiler(JIT& jit)
+  : targetMachine(jit.createTargetMachine()), thread([this] { run(); }) {}
+
+BackgroundCompiler::~BackgroundCompiler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  tasksAvailable.notify_one();
+  thread.join();
+}
+
+std::future<CompiledDefinition>
+BackgroundCompiler::compile(llvm::Module const& module, bool printIR) {
+  Task task;
+  llvm::raw_string_ostream stream(task.bitcode);
+  llvm::WriteBitcodeToFile(&module, stream);
+  stream.flush();
+  task.printIR = printIR;
+  auto result = task.result.get_future();
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(std::move(task));
+  }
+  tasksAvailable.notify_one();
+  return result;
+}
+
+void BackgroundCompiler::run() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      tasksAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+      if (stopping) return;
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    
+    task.result.set_value(compile(task));
+  }
+}
+
+CompiledDefinition BackgroundCompiler::compile(Task& task) {
+  CompiledDefinition result;
+  LatencyTimer latencyTimer(getDefinitionCompileLatency());
+  
+  auto buffer = llvm::MemoryBuffer::getMemBuffer(task.bitcode, "eaxbackground",
+                                                 false);
+  auto module = llvm::parseBitcodeFile(buffer->getMemBufferRef(), context);
+  if (!module) {
+    error("couldn't read the IR of a definition: ", module.getError().message());
+    latencyTimer.cancel();
+    return result;
+  }
+  
+  auto fnPassManager = createFnPassManager(**module, *targetMachine);
+  for (auto& fn : **module) {
+    if (fn.isDeclaration()) continue;
+    fnPassManager->run(fn);
+    
+    if (task.printIR) {
+      llvm::raw_string_ostream stream(result.ir);
+      fn.print(stream);
+    }
+  }
+  
+  result.names = JIT::prepareDefinitions(**module);
+  PhaseTimer timer("codegen", result.names.empty() ? "" : result.names.front());
+  result.object = llvm::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+    llvm::orc::SimpleCompiler(*targetMachine)(**module));
+  return result;
+}
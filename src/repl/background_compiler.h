@@ -0,0 +1,60 @@
+#ifndef EAX_BACKGROUND_COMPILER_H
+#define EAX_BACKGROUND_COMPILER_H
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "batch_compiler.h"
+#include "jit.h"
+
+namespace eax {
+
+/// Optimizes and generates machine code for modules on a background thread,
+/// so that the REPL doesn't have to wait for them. The modules are handed
+/// over as bitcode, since IR can't be shared between LLVMContexts, and are
+/// compiled in the order they're submitted. Linking the results into the JIT
+/// is left to the caller.
+class BackgroundCompiler {
+public:
+  BackgroundCompiler(JIT& jit);
+  BackgroundCompiler(BackgroundCompiler const&) = delete;
+  BackgroundCompiler& operator=(BackgroundCompiler const&) = delete;
+  ~BackgroundCompiler();
+  
+  /// Queues the unoptimized definitions in "module" for compilation. The
+  /// module can be reused or destroyed as soon as this returns. If "printIR"
+  /// is set, the result includes the optimized IR.
+  std::future<CompiledDefinition> compile(llvm::Module const& module,
+                                          bool printIR);
+  
+private:
+  struct Task {
+    std::string bitcode;
+    bool printIR;
+    std::promise<CompiledDefinition> result;
+  };
+  
+  void run();
+  CompiledDefinition compile(Task& task);
+  
+private:
+  llvm::LLVMContext context;
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  std::mutex mutex;
+  std::condition_variable tasksAvailable;
+  std::deque<Task> tasks;
+  bool stopping = false;
+  std::thread thread; // Must be initialized last.
+};
+
+}
+
+#endif
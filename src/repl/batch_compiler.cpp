@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/IR/Module.h>
+
+#include "batch_compiler.h"
+#include "../ast/function.h"
+#include "../ir_gen/optimizer.h"
+#include "../util/metrics.h"
+#include "../util/timings.h"
+
+using namespace eax;
+
+Histogram& eax::getDefinitionCompileLatency() {
+  static Histogram& histogram = Metrics::get().getHistogram(
+    "eax_definition_compile_seconds",
+    "Time to optimize a definition and generate its machine code");
+  return histogram;
+}
+
+class BatchCompiler::Worker {
+public:
+  Worker(JIT& jit)
+    : irgen(context), targetMachine(jit.createTargetMachine()) {}
+  
+  void importSignatures(IrGen const& other) {
+    irgen.importSignatures(other);
+    irgen.setFastMathFlags(other.getFastMathFlags());
+    irgen.setProfileCalls(other.getProfileCalls());
+    irgen.setKeepFramePointers(other.getKeepFramePointers());
+    irgen.setPGOInstrument(other.getPGOInstrument());
+    irgen.setPGOProfile(other.getPGOProfile());
+  }
+  
+  CompiledDefinition compile(Function& function) {
+    CompiledDefinition result;
+    LatencyTimer latencyTimer(getDefinitionCompileLatency());
+    
+    // Each definition gets a module of its own, like in the REPL, so that
+    // the JIT can free it once it's been superseded.
+    auto module = llvm::make_unique<llvm::Module>("eaxbatch", context);
+    module->setDataLayout(targetMachine->createDataLayout());
+    auto fnPassManager = createFnPassManager(*module, *targetMachine);
+    
+    irgen.setModule(*module);
+    irgen.setFnPassManager(fnPassManager.get());
+    function.accept(irgen);
+    irgen.setFnPassManager(nullptr);
+    if (!irgen.getResult()) {
+      latencyTimer.cancel();
+      return result;
+    }
+    
+    for (auto& decl : *module) {
+      if (decl.isDeclaration() && !decl.isIntrinsic())
+        result.callees.push_back(decl.getName());
+    }
+    
+    result.names = JIT::prepareDefinitions(*module);
+    PhaseTimer timer("codegen", result.names.front());
+    result.object = llvm::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+      llvm::orc::SimpleCompiler(*targetMachine)(*module));
+    return result;
+  }
+  
+private:
+  llvm::LLVMContext context; // Must outlive irgen.
+  IrGen irgen;
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+};
+
+BatchCompiler::BatchCompiler(JIT& jit, unsigned numThreads) {
+  for (unsigned i = 0; i < std::max(numThreads, 1u); ++i) {
+    workers.push_back(llvm::make_unique<Worker>(jit));
+  }
+}
+
+BatchCompiler::~BatchCompiler() = default;
+
+std::vector<CompiledDefinition>
+BatchCompiler::compile(llvm::ArrayRef<Function*> definitions,
+                       IrGen const& irgen) {
+  std::vector<CompiledDefinition> results(definitions.size());
+  auto numThreads = std::min(workers.size(), definitions.size());
+  
+  // Import the signatures before starting the threads, so that the workers
+  // don't read "irgen" concurrently.
+  for (size_t i = 0; i < numThreads; ++i) {
+    workers[i]->importSignatures(irgen);
+  }
+  
+  // Hand out the definitions dynamically, since their sizes vary. The
+  // results are stored by index, so the output order is deterministic.
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  
+  for (size_t i = 0; i < numThreads; ++i) {
+    threads.emplace_back([&, i] {
+      for (size_t j; (j = next++) < definitions.size();) {
+        results[j] = workers[i]->compile(*definitions[j]);
+      }
+    });
+  }
+  
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  
+  return results;
+}
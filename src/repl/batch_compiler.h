@@ -0,0 +1,52 @@
+#ifndef EAX_BATCH_COMPILER_H
+#define EAX_BATCH_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/LLVMContext.h>
+
+#include "jit.h"
+#include "../ir_gen/ir_gen.h"
+
+namespace eax {
+
+class Function;
+
+/// The machine code of a function definition compiled by a BatchCompiler.
+struct CompiledDefinition {
+  JIT::ObjectPtr object; // Null if compilation failed.
+  std::vector<std::string> names; // For JIT::addDefinitionObject().
+  std::vector<std::string> callees;
+  std::string ir; // The optimized IR, if it was requested.
+};
+
+class Histogram;
+
+/// Returns the histogram of the time it takes to optimize a definition and
+/// generate its machine code, in a BatchCompiler or a BackgroundCompiler.
+Histogram& getDefinitionCompileLatency();
+
+/// Compiles function definitions concurrently on a pool of worker threads.
+/// Each worker has its own LLVMContext, IrGen, pass manager and target
+/// machine, so IR generation, optimization and machine code generation all
+/// run in parallel. Linking the results into the JIT is left to the caller.
+class BatchCompiler {
+public:
+  BatchCompiler(JIT& jit, unsigned numThreads);
+  ~BatchCompiler();
+  
+  /// Compiles the given definitions, using the function signatures known to
+  /// "irgen" for calls. Returns the results in the same order.
+  std::vector<CompiledDefinition> compile(llvm::ArrayRef<Function*> definitions,
+                                          IrGen const& irgen);
+  
+private:
+  class Worker;
+  std::vector<std::unique_ptr<Worker>> workers;
+};
+
+}
+
+#endif
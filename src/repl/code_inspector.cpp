@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Mangler.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "code_inspector.h"
+
+using namespace eax;
+
+namespace {
+
+/// Collects the diagnostics reported to an LLVMContext while it exists,
+/// instead of the context's own handler.
+class RemarkCollector {
+public:
+  RemarkCollector(llvm::LLVMContext& context, std::string& remarks)
+    : context(context), stream(remarks),
+      previousHandler(context.getDiagnosticHandler()),
+      previousHandlerContext(context.getDiagnosticContext()) {
+    context.setDiagnosticHandler(handleDiagnostic, this);
+  }
+  
+  ~RemarkCollector() {
+    context.setDiagnosticHandler(previousHandler, previousHandlerContext);
+    stream.flush();
+  }
+  
+private:
+  static void handleDiagnostic(llvm::DiagnosticInfo const& info, void* context) {
+    auto& stream = static_cast<RemarkCollector*>(context)->stream;
+    auto remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&info);
+    if (!remark) {
+      // Keep other diagnostics, e.g. warnings from the code generator, too.
+      llvm::DiagnosticPrinterRawOStream printer(stream);
+      info.print(printer);
+      stream << '\n';
+      return;
+    }
+    
+    switch (remark->getKind()) {
+    case llvm::DK_OptimizationRemark: stream << "passed"; break;
+    case llvm::DK_OptimizationRemarkMissed: stream << "missed"; break;
+    default: stream << "analysis"; break;
+    }
+    stream << " (" << remark->getPassName() << "): " << remark->getMsg() << '\n';
+  }
+  
+private:
+  llvm::LLVMContext& context;
+  llvm::raw_string_ostream stream;
+  llvm::LLVMContext::DiagnosticHandlerTy previousHandler;
+  void* previousHandlerContext;
+};
+
+}
+
+/// Returns the size of the machine code of the function "name" in an
+/// object compiled from "module", or 0 if it isn't found.
+static uint64_t getCodeSize(llvm::Module& module, llvm::StringRef name,
+                            llvm::TargetMachine& targetMachine) {
+  std::string mangledName;
+  {
+    llvm::raw_string_ostream stream(mangledName);
+    llvm::Mangler::getNameWithPrefix(stream, name, module.getDataLayout());
+  }
+  
+  auto object = llvm::orc::SimpleCompiler(targetMachine)(module);
+  if (!object.getBinary()) return 0;
+  
+  for (auto const& symbolAndSize :
+       llvm::object::computeSymbolSizes(*object.getBinary())) {
+    auto symbolName = symbolAndSize.first.getName();
+    if (!symbolName) {
+      llvm::consumeError(symbolName.takeError());
+      continue;
+    }
+    if (*symbolName == mangledName) return symbolAndSize.second;
+  }
+  return 0;
+}
+
+CodeInspection eax::inspectFunction(llvm::Module& module, llvm::StringRef name,
+                                    llvm::TargetMachine& targetMachine) {
+  CodeInspection result;
+  llvm::Function* fn = module.getFunction(name);
+  assert(fn && !fn->isDeclaration() && "function not defined in the module");
+  
+  {
+    llvm::raw_string_ostream stream(result.unoptimizedIR);
+    fn->print(stream);
+  }
+  
+  RemarkCollector remarkCollector(module.getContext(), result.remarks);
+  auto fnPassManager = createFnPassManager(module, targetMachine,
+                                           &result.passStatistics);
+  fnPassManager->run(*fn);
+  
+  {
+    llvm::raw_string_ostream stream(result.optimizedIR);
+    fn->print(stream);
+  }
+  
+  // Code generation changes the IR, so the assembly is emitted from a copy,
+  // and the object is compiled from the original.
+  auto copy = llvm::CloneModule(&module);
+  llvm::SmallString<0> assembly;
+  llvm::raw_svector_ostream assemblyStream(assembly);
+  llvm::legacy::PassManager codegenPassManager;
+  if (targetMachine.addPassesToEmitFile(codegenPassManager, assemblyStream,
+                                        llvm::TargetMachine::CGFT_AssemblyFile)) {
+    result.assembly = "the target can't emit assembly\n";
+  } else {
+    codegenPassManager.run(*copy);
+    result.assembly = assembly.str();
+  }
+  
+  result.codeSize = getCodeSize(module, name, targetMachine);
+  return result;
+}
+
+void eax::printPassStatistics(std::ostream& out, PassStatistics const& statistics) {
+  size_t passWidth = 4;
+  for (auto const& entry : statistics.entries) {
+    passWidth = std::max(passWidth, entry.pass.size());
+  }
+  
+  auto flags = out.flags();
+  out << std::left << std::setw(passWidth) << "pass" << std::right
+      << std::setw(8) << "blocks" << std::setw(14) << "instructions" << '\n';
+  for (auto const& entry : statistics.entries) {
+    out << std::left << std::setw(passWidth) << entry.pass << std::right
+        << std::setw(8) << entry.basicBlocks
+        << std::setw(14) << entry.instructions << '\n';
+  }
+  out.flush();
+  out.flags(flags);
+}
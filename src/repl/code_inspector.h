@@ -0,0 +1,39 @@
+#ifndef EAX_CODE_INSPECTOR_H
+#define EAX_CODE_INSPECTOR_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "../ir_gen/optimizer.h"
+
+namespace eax {
+
+/// What the compiler makes of a function, for tuning it.
+struct CodeInspection {
+  std::string unoptimizedIR;
+  std::string optimizedIR;
+  std::string assembly;
+  uint64_t codeSize = 0; // In bytes of machine code.
+  PassStatistics passStatistics;
+  
+  /// The optimization remarks of the passes and the code generator, one per
+  /// line, e.g. about operations they couldn't vectorize.
+  std::string remarks;
+};
+
+/// Runs the function "name" of "module", which must not have been optimized
+/// yet, through the same pipeline as the JIT, and records the intermediate
+/// results. The module is modified in the process.
+CodeInspection inspectFunction(llvm::Module& module, llvm::StringRef name,
+                               llvm::TargetMachine& targetMachine);
+
+/// Prints the size of the function after each pass of the pipeline.
+void printPassStatistics(std::ostream& out, PassStatistics const& statistics);
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include <iterator>
+
+#include "code_map.h"
+
+using namespace eax;
+
+void CodeMap::add(void const* owner, uint64_t address, uint64_t size,
+                  std::string name) {
+  if (size == 0) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  // Drop any stale ranges the new function overlaps, in case the memory of
+  // a removed object has been reused without it having been removed here.
+  auto iterator = entries.lower_bound(address);
+  if (iterator != entries.begin() && std::prev(iterator)->second.end > address) {
+    --iterator;
+  }
+  while (iterator != entries.end() && iterator->first < address + size) {
+    iterator = entries.erase(iterator);
+  }
+  
+  entries.emplace(address, Entry{address + size, std::move(name), owner});
+}
+
+void CodeMap::remove(void const* owner) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto iterator = entries.begin(); iterator != entries.end();) {
+    if (iterator->second.owner == owner) {
+      iterator = entries.erase(iterator);
+    } else {
+      ++iterator;
+    }
+  }
+}
+
+std::string CodeMap::lookup(uint64_t address) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto iterator = entries.upper_bound(address);
+  if (iterator == entries.begin()) return "";
+  --iterator;
+  return address < iterator->second.end ? iterator->second.name : "";
+}
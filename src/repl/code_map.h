@@ -0,0 +1,40 @@
+#ifndef EAX_CODE_MAP_H
+#define EAX_CODE_MAP_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace eax {
+
+/// The address ranges of the functions in the JIT's loaded objects, for
+/// mapping program counters, e.g. in profiler samples, back to the eax
+/// functions they belong to. Can be used from any thread.
+class CodeMap {
+public:
+  /// Records a function of the object identified by "owner".
+  void add(void const* owner, uint64_t address, uint64_t size, std::string name);
+  
+  /// Forgets the functions of an object that has been removed.
+  void remove(void const* owner);
+  
+  /// Returns the name of the function containing "address", or an empty
+  /// string if it isn't in JIT-compiled code.
+  std::string lookup(uint64_t address) const;
+  
+private:
+  struct Entry {
+    uint64_t end;
+    std::string name;
+    void const* owner;
+  };
+  
+private:
+  mutable std::mutex mutex;
+  std::map<uint64_t, Entry> entries; // By start address.
+};
+
+}
+
+#endif
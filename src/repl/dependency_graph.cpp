@@ -0,0 +1,29 @@
+#include "dependency_graph.h"
+
+using namespace eax;
+
+void DependencyGraph::setCallees(std::string const& caller,
+                                 std::vector<std::string> newCallees) {
+  auto& oldCallees = callees[caller];
+  
+  for (auto const& callee : oldCallees) {
+    callers[callee].erase(caller);
+  }
+  for (auto const& callee : newCallees) {
+    callers[callee].insert(caller);
+  }
+  
+  oldCallees = std::move(newCallees);
+}
+
+std::vector<std::string> DependencyGraph::getCallees(std::string const& caller) const {
+  auto iterator = callees.find(caller);
+  if (iterator == callees.end()) return {};
+  return iterator->second;
+}
+
+std::vector<std::string> DependencyGraph::getCallers(std::string const& callee) const {
+  auto iterator = callers.find(callee);
+  if (iterator == callers.end()) return {};
+  return {iterator->second.begin(), iterator->second.end()};
+}
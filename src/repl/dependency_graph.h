@@ -0,0 +1,32 @@
+#ifndef EAX_DEPENDENCY_GRAPH_H
+#define EAX_DEPENDENCY_GRAPH_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace eax {
+
+/// Records which function definitions call which, so that the callers
+/// affected by a redefinition can be found.
+class DependencyGraph {
+public:
+  /// Records that "caller" calls exactly the given functions, replacing
+  /// any previously recorded callees of "caller".
+  void setCallees(std::string const& caller, std::vector<std::string> callees);
+  
+  /// Returns the functions that "caller" directly calls.
+  std::vector<std::string> getCallees(std::string const& caller) const;
+  
+  /// Returns the functions that directly call "callee", in name order.
+  std::vector<std::string> getCallers(std::string const& callee) const;
+  
+private:
+  std::unordered_map<std::string, std::vector<std::string>> callees;
+  std::unordered_map<std::string, std::set<std::string>> callers;
+};
+
+}
+
+#endif
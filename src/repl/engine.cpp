@@ -0,0 +1,46 @@
+#include <llvm/ADT/STLExtras.h>
+
+#include "engine.h"
+#include "../util/metrics.h"
+
+using namespace eax;
+
+Engine::Engine(JITOptions const& jitOptions, SessionOptions const& sessionOptions)
+  : jit(jitOptions),
+    sessionOptions(sessionOptions),
+    prelude(llvm::make_unique<Session>(jit, "", sessionOptions)),
+    nextSessionID(0) {
+  Metrics& metrics = Metrics::get();
+  Gauge& modules = metrics.getGauge(
+    "eax_jit_modules", "Number of modules held by the JIT");
+  Gauge& usedBytes = metrics.getGauge(
+    "eax_jit_memory_used_bytes", "Memory held by the code and data of live modules");
+  Gauge& mappedBytes = metrics.getGauge(
+    "eax_jit_memory_mapped_bytes", "Memory mapped by the JIT, including freed "
+    "memory kept for reuse");
+  
+  metricsCollectorID = metrics.addCollector([this, &modules, &usedBytes, &mappedBytes] {
+    JITMemoryUsage usage = jit.getMemoryUsage();
+    modules.set(usage.modules);
+    usedBytes.set(usage.usedBytes);
+    mappedBytes.set(usage.mappedBytes);
+  });
+}
+
+Engine::~Engine() {
+  Metrics::get().removeCollector(metricsCollectorID);
+}
+
+std::unique_ptr<Session> Engine::createSession() {
+  // Make sure that the prelude's stubs are all bound.
+  {
+    std::lock_guard<std::mutex> lock(preludeMutex);
+    prelude->linkCompiledDefinitions(true);
+  }
+  
+  // The scope is never reused, since the stubs of a destroyed session can't
+  // be removed from the JIT.
+  std::string scope = "session" + std::to_string(nextSessionID++) + "$";
+  return llvm::make_unique<Session>(jit, std::move(scope), sessionOptions,
+                                    prelude.get());
+}
@@ -0,0 +1,47 @@
+#ifndef EAX_ENGINE_H
+#define EAX_ENGINE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "jit.h"
+#include "session.h"
+
+namespace eax {
+
+/// Owns the JIT shared by any number of sessions, and a prelude session
+/// whose definitions are compiled once and can be called from all of them.
+/// Sessions can be created and used concurrently from different threads.
+///
+/// The engine and its sessions report their resource usage and latencies to
+/// Metrics::get(), where embedders can read them.
+class Engine {
+public:
+  Engine(JITOptions const& jitOptions, SessionOptions const& sessionOptions);
+  Engine(Engine const&) = delete;
+  Engine& operator=(Engine const&) = delete;
+  ~Engine();
+  
+  JIT& getJIT() { return jit; }
+  
+  /// Returns the session holding the prelude. Its definitions are visible
+  /// to the sessions created after them, so it must be populated before any
+  /// other session is created, and not changed while they exist.
+  Session& getPrelude() { return *prelude; }
+  
+  /// Creates a new session with no definitions of its own.
+  std::unique_ptr<Session> createSession();
+  
+private:
+  JIT jit;
+  SessionOptions const sessionOptions;
+  std::unique_ptr<Session> prelude;
+  std::mutex preludeMutex; // Guards linking the prelude.
+  std::atomic<unsigned> nextSessionID;
+  size_t metricsCollectorID; // Updates the JIT's metrics.
+};
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+#include "expr_benchmark.h"
+
+using namespace eax;
+
+using Clock = std::chrono::steady_clock;
+
+/// Batches are made at least this long, so that reading the clock adds
+/// little to the measured time.
+static double const minBatchSeconds = 1e-6;
+static double const minWarmupSeconds = 0.01;
+static double const defaultSeconds = 1;
+static uint64_t const maxDefaultCalls = 100000000;
+
+/// Makes the compiler assume that "value" is used, so that the call that
+/// produced it can't be removed.
+template<typename T>
+static void doNotOptimize(T const& value) {
+#if defined(__GNUC__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile T sink;
+  sink = value;
+#endif
+}
+
+namespace {
+
+/// Times batches of calls of a function returning T.
+template<typename T>
+class CallTimer {
+public:
+  CallTimer(llvm::orc::TargetAddress address)
+    : fn(reinterpret_cast<T(*)()>(address)) {}
+  
+  double operator()(uint64_t calls) const {
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < calls; ++i) {
+      doNotOptimize(fn());
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  
+private:
+  T (*fn)();
+};
+
+/// Times batches of calls of a function that stores a tuple to an array.
+class TupleCallTimer {
+public:
+  TupleCallTimer(llvm::orc::TargetAddress address, size_t size)
+    : fn(reinterpret_cast<void(*)(double*)>(address)), size(size) {}
+  
+  double operator()(uint64_t calls) const {
+    std::vector<double> elements(size);
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < calls; ++i) {
+      fn(elements.data());
+      doNotOptimize(elements.front());
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  
+private:
+  void (*fn)(double*);
+  size_t size;
+};
+
+}
+
+template<typename CallTimerT>
+static ExprBenchmarkResult benchmark(CallTimerT const& timeCalls, uint64_t calls) {
+  ExprBenchmarkResult result = {};
+  
+  // Warm up, and find how many calls make a batch long enough to time.
+  uint64_t batchSize = 1;
+  double batchSeconds;
+  double warmupSeconds = 0;
+  for (;;) {
+    batchSeconds = timeCalls(batchSize);
+    result.warmupCalls += batchSize;
+    warmupSeconds += batchSeconds;
+    if (batchSeconds < minBatchSeconds) batchSize *= 2;
+    else if (warmupSeconds >= minWarmupSeconds) break;
+  }
+  
+  if (calls == 0) {
+    double secondsPerCall = batchSeconds / batchSize;
+    calls = uint64_t(defaultSeconds / secondsPerCall);
+    calls = std::max(std::min(calls, maxDefaultCalls), batchSize);
+  }
+  batchSize = std::min(batchSize, calls);
+  
+  std::vector<double> samples(calls / batchSize);
+  double totalSeconds = 0;
+  for (auto& sample : samples) {
+    double seconds = timeCalls(batchSize);
+    totalSeconds += seconds;
+    sample = seconds / batchSize;
+  }
+  std::sort(samples.begin(), samples.end());
+  
+  result.calls = samples.size() * batchSize;
+  result.callsPerSample = batchSize;
+  result.minSeconds = samples.front();
+  result.medianSeconds = samples[samples.size() / 2];
+  result.p99Seconds = samples[size_t(std::ceil(samples.size() * 0.99)) - 1];
+  result.meanSeconds = totalSeconds / result.calls;
+  return result;
+}
+
+ExprBenchmarkResult eax::benchmarkExpr(llvm::orc::TargetAddress address,
+                                       llvm::Type* type, uint64_t calls) {
+  if (type->isIntegerTy(1)) return benchmark(CallTimer<bool>(address), calls);
+  if (type->isStructTy()) {
+    return benchmark(TupleCallTimer(address, type->getStructNumElements()), calls);
+  }
+  return benchmark(CallTimer<double>(address), calls);
+}
+
+/// Prints a duration with a unit that keeps it readable.
+static void printDuration(std::ostream& out, double seconds) {
+  static char const* const units[] = {"s", "ms", "us", "ns"};
+  unsigned unit = 0;
+  while (seconds < 1 && unit < 3) {
+    seconds *= 1000;
+    ++unit;
+  }
+  out << std::setprecision(3) << seconds << ' ' << units[unit];
+}
+
+void eax::printExprBenchmarkResult(std::ostream& out, ExprBenchmarkResult const& result) {
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out << std::fixed;
+  out << "calls:      " << result.calls << " in " << result.calls / result.callsPerSample
+      << " samples of " << result.callsPerSample << ", after "
+      << result.warmupCalls << " warm-up calls\n";
+  out << "min:        ";
+  printDuration(out, result.minSeconds);
+  out << "\nmedian:     ";
+  printDuration(out, result.medianSeconds);
+  out << "\np99:        ";
+  printDuration(out, result.p99Seconds);
+  out << "\nmean:       ";
+  printDuration(out, result.meanSeconds);
+  out << "\nthroughput: " << std::setprecision(0) << 1 / result.meanSeconds
+      << " calls/s" << std::endl;
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -0,0 +1,36 @@
+#ifndef EAX_EXPR_BENCHMARK_H
+#define EAX_EXPR_BENCHMARK_H
+
+#include <cstdint>
+#include <ostream>
+#include <llvm/ExecutionEngine/Orc/JITSymbol.h>
+#include <llvm/IR/Type.h>
+
+namespace eax {
+
+/// The distribution of the time per call of a compiled expression.
+struct ExprBenchmarkResult {
+  uint64_t warmupCalls;
+  uint64_t calls; // Not including the warm-up.
+  uint64_t callsPerSample;
+  double minSeconds; // Of the samples, per call.
+  double medianSeconds;
+  double p99Seconds;
+  double meanSeconds; // Of all calls.
+};
+
+/// Calls a compiled top-level expression repeatedly, and measures how long
+/// each call takes. Calls that are too short to time individually are timed
+/// in batches, and each batch counts as one sample. After warming up, runs
+/// "calls" calls, or about a second's worth if "calls" is 0. The results
+/// are passed through an optimization barrier, so that the calls can't be
+/// optimized away, but the expression itself is compiled as usual, so
+/// constant subexpressions may be folded at compile time.
+ExprBenchmarkResult benchmarkExpr(llvm::orc::TargetAddress address,
+                                  llvm::Type* type, uint64_t calls);
+
+void printExprBenchmarkResult(std::ostream& out, ExprBenchmarkResult const& result);
+
+}
+
+#endif
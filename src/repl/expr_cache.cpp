@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <llvm/ADT/STLExtras.h>
+
+#include "expr_cache.h"
+#include "../ast/ast_printer.h"
+#include "../ast/expr.h"
+
+using namespace eax;
+
+ExprCache::~ExprCache() {
+  if (uncached) jit.removeModule(uncached->module);
+  while (!entries.empty()) {
+    erase(entries.begin());
+  }
+}
+
+std::string ExprCache::getCanonicalForm(Expr& expr) {
+  std::ostringstream stream;
+  // Print numbers with enough digits to tell all doubles apart.
+  stream.precision(std::numeric_limits<double>::max_digits10);
+  AstPrinter printer(stream);
+  expr.accept(printer);
+  return stream.str();
+}
+
+CachedExpr const* ExprCache::lookup(size_t hash, std::string const& source) {
+  auto iterator = index.find(hash);
+  if (iterator == index.end() || iterator->second->second.source != source)
+    return nullptr;
+  
+  entries.splice(entries.begin(), entries, iterator->second);
+  return &iterator->second->second;
+}
+
+CachedExpr const* ExprCache::insert(size_t hash, CachedExpr expr) {
+  if (capacity == 0) {
+    if (uncached) jit.removeModule(uncached->module);
+    uncached = llvm::make_unique<CachedExpr>(std::move(expr));
+    return uncached.get();
+  }
+  
+  auto iterator = index.find(hash);
+  if (iterator != index.end()) erase(iterator->second);
+  
+  if (entries.size() == capacity) erase(std::prev(entries.end()));
+  
+  entries.emplace_front(hash, std::move(expr));
+  index[hash] = entries.begin();
+  return &entries.front().second;
+}
+
+void ExprCache::invalidate(std::string const& fnName) {
+  for (auto iterator = entries.begin(); iterator != entries.end();) {
+    auto const& callees = iterator->second.callees;
+    if (std::find(callees.begin(), callees.end(), fnName) != callees.end()) {
+      erase(iterator++);
+    } else {
+      ++iterator;
+    }
+  }
+}
+
+void ExprCache::erase(std::list<Entry>::iterator entry) {
+  jit.removeModule(entry->second.module);
+  index.erase(entry->first);
+  entries.erase(entry);
+}
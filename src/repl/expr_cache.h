@@ -0,0 +1,72 @@
+#ifndef EAX_EXPR_CACHE_H
+#define EAX_EXPR_CACHE_H
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "jit.h"
+
+namespace eax {
+
+class Expr;
+
+/// A compiled top-level expression that is kept resident in the JIT. If the
+/// expression is a tuple, "address" is that of a function that stores its
+/// elements to an array of doubles (see IrGen::createTupleWriter()).
+struct CachedExpr {
+  JIT::ModuleHandleT module;
+  llvm::orc::TargetAddress address;
+  llvm::Type* type;
+  std::vector<std::string> callees;
+  std::string source; // See ExprCache::getCanonicalForm().
+};
+
+/// A size-bounded cache of compiled top-level expressions, keyed by the
+/// structural hash of their ASTs. Since different expressions can have the
+/// same hash, a hit is only returned if the canonical forms match too. The
+/// least recently used entry is evicted when the cache is full.
+class ExprCache {
+public:
+  ExprCache(JIT& jit, size_t capacity) : jit(jit), capacity(capacity) {}
+  ExprCache(ExprCache const&) = delete;
+  ExprCache& operator=(ExprCache const&) = delete;
+  ~ExprCache();
+  
+  /// Returns the text that identifies an expression in the cache, which is
+  /// the same for structurally identical expressions.
+  static std::string getCanonicalForm(Expr& expr);
+  
+  /// Returns the cached expression with the given hash and canonical form,
+  /// or null.
+  CachedExpr const* lookup(size_t hash, std::string const& source);
+  
+  /// Adds a compiled expression to the cache, which takes over its module.
+  /// Returns the added expression, which stays valid at least until the
+  /// next insertion, even if the cache has no capacity.
+  CachedExpr const* insert(size_t hash, CachedExpr);
+  
+  /// Removes the expressions that call the given function, e.g. because it
+  /// has been redefined.
+  void invalidate(std::string const& fnName);
+  
+  size_t size() const { return entries.size(); }
+  
+private:
+  using Entry = std::pair<size_t, CachedExpr>;
+  
+  void erase(std::list<Entry>::iterator);
+  
+private:
+  JIT& jit;
+  size_t const capacity;
+  std::list<Entry> entries; // From most to least recently used.
+  std::unordered_map<size_t, std::list<Entry>::iterator> index;
+  std::unique_ptr<CachedExpr> uncached; // The last insertion, if capacity is 0.
+};
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <cstdint>
+
+#include "gdb_registrar.h"
+
+using namespace eax;
+
+// The GDB JIT interface (see "JIT Compilation Interface" in the GDB manual).
+// The debugger sets a breakpoint in __jit_debug_register_code(), and reads
+// the entry named in __jit_debug_descriptor when it's called. Both are
+// defined by LLVM's ExecutionEngine library.
+extern "C" {
+
+enum JITAction { JIT_NOACTION = 0, JIT_REGISTER_FN, JIT_UNREGISTER_FN };
+
+struct jit_code_entry {
+  jit_code_entry* next_entry;
+  jit_code_entry* prev_entry;
+  char const* symfile_addr;
+  uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+  uint32_t version;
+  uint32_t action_flag;
+  jit_code_entry* relevant_entry;
+  jit_code_entry* first_entry;
+};
+
+extern jit_descriptor __jit_debug_descriptor;
+void __jit_debug_register_code();
+
+}
+
+/// Guards the descriptor, which is shared by all registrars.
+static std::mutex descriptorMutex;
+
+struct GDBRegistrar::Registration {
+  llvm::object::OwningBinary<llvm::object::ObjectFile> object;
+  jit_code_entry entry;
+};
+
+GDBRegistrar::~GDBRegistrar() {
+  while (!registrations.empty()) {
+    remove(registrations.begin()->first);
+  }
+}
+
+void GDBRegistrar::add(void const* owner,
+                       llvm::object::OwningBinary<llvm::object::ObjectFile> debugObject) {
+  std::unique_ptr<Registration> registration(new Registration());
+  registration->object = std::move(debugObject);
+  auto data = registration->object.getBinary()->getData();
+  jit_code_entry& entry = registration->entry;
+  entry.symfile_addr = data.data();
+  entry.symfile_size = data.size();
+  
+  std::lock_guard<std::mutex> lock(descriptorMutex);
+  entry.prev_entry = nullptr;
+  entry.next_entry = __jit_debug_descriptor.first_entry;
+  if (entry.next_entry) entry.next_entry->prev_entry = &entry;
+  __jit_debug_descriptor.first_entry = &entry;
+  __jit_debug_descriptor.relevant_entry = &entry;
+  __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+  __jit_debug_register_code();
+  
+  registrations.emplace(owner, std::move(registration));
+}
+
+void GDBRegistrar::remove(void const* owner) {
+  auto range = registrations.equal_range(owner);
+  std::lock_guard<std::mutex> lock(descriptorMutex);
+  
+  for (auto iterator = range.first; iterator != range.second; ++iterator) {
+    jit_code_entry& entry = iterator->second->entry;
+    if (entry.prev_entry) {
+      entry.prev_entry->next_entry = entry.next_entry;
+    } else {
+      __jit_debug_descriptor.first_entry = entry.next_entry;
+    }
+    if (entry.next_entry) entry.next_entry->prev_entry = entry.prev_entry;
+    
+    __jit_debug_descriptor.relevant_entry = &entry;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+  }
+  
+  registrations.erase(range.first, range.second);
+}
@@ -0,0 +1,40 @@
+#ifndef EAX_GDB_REGISTRAR_H
+#define EAX_GDB_REGISTRAR_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <llvm/Object/ObjectFile.h>
+
+namespace eax {
+
+/// Registers JIT-compiled objects with debuggers through the GDB JIT
+/// interface, so that GDB and LLDB can show the names of JIT-compiled
+/// functions in backtraces and set breakpoints on them. Not thread-safe;
+/// the JIT calls it under its lock.
+class GDBRegistrar {
+public:
+  GDBRegistrar() = default;
+  GDBRegistrar(GDBRegistrar const&) = delete;
+  GDBRegistrar& operator=(GDBRegistrar const&) = delete;
+  ~GDBRegistrar();
+  
+  /// Registers an object whose sections have been relocated to their load
+  /// addresses (see llvm::RuntimeDyld::LoadedObjectInfo::getObjectForDebug()).
+  /// "owner" identifies the set of objects it belongs to.
+  void add(void const* owner,
+           llvm::object::OwningBinary<llvm::object::ObjectFile> debugObject);
+  
+  /// Unregisters the objects of "owner", before their code is freed.
+  void remove(void const* owner);
+  
+private:
+  struct Registration;
+  
+private:
+  std::multimap<void const*, std::unique_ptr<Registration>> registrations;
+};
+
+}
+
+#endif
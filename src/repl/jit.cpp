@@ -1,53 +1,274 @@
+#include <algorithm>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
 #include <llvm/ExecutionEngine/Orc/CompileUtils.h>
 #include <llvm/ExecutionEngine/Orc/LambdaResolver.h>
 #include <llvm/IR/Mangler.h>
+#include <llvm/Object/SymbolSize.h>
 #include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/ADT/StringMap.h>
 
 #include "jit.h"
+#include "../util/error.h"
+#include "../util/timings.h"
 
 using namespace eax;
 
-JIT::JIT()
-  : targetMachine(llvm::EngineBuilder().selectTarget()),
+static llvm::TargetMachine* selectTarget(JITOptions const& options) {
+  llvm::EngineBuilder builder;
+  
+  if (options.targetHostCPU) {
+    builder.setMCPU(llvm::sys::getHostCPUName());
+    
+    llvm::StringMap<bool> hostFeatures;
+    std::vector<std::string> attrs;
+    if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+      for (auto const& feature : hostFeatures) {
+        attrs.push_back((feature.second ? "+" : "-") + feature.first().str());
+      }
+    }
+    builder.setMAttrs(attrs);
+  }
+  
+  llvm::TargetOptions targetOptions;
+  if (options.fuseFPOps)
+    targetOptions.AllowFPOpFusion = llvm::FPOpFusion::Fast;
+  targetOptions.UnsafeFPMath = options.unsafeFPMath;
+  targetOptions.NoNaNsFPMath = options.noNaNsFPMath;
+  targetOptions.NoInfsFPMath = options.noInfsFPMath;
+  builder.setTargetOptions(targetOptions);
+  
+  return builder.selectTarget();
+}
+
+JIT::JIT(JITOptions const& options)
+  : options(options),
+    targetMachine(selectTarget(options)),
     dataLayout((assert(targetMachine), targetMachine->createDataLayout())),
-    compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)) {
+    objectLayer(LoadListener{this}),
+    compileLayer(objectLayer, llvm::orc::SimpleCompiler(*targetMachine)),
+    stubsManager(llvm::orc::createLocalIndirectStubsManagerBuilder(
+      targetMachine->getTargetTriple())()) {
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  if (options.writePerfMap) perfMap = llvm::make_unique<PerfMap>();
+  if (options.registerWithDebugger) gdbRegistrar = llvm::make_unique<GDBRegistrar>();
 }
 
-JIT::ModuleHandleT JIT::addModule(std::unique_ptr<llvm::Module> module) {
-  // We need a memory manager to allocate memory and resolve symbols for this
-  // new module. Create one that resolves symbols by looking back into the JIT.
-  auto resolver = llvm::orc::createLambdaResolver(
-    [&](std::string const& name) {
-      if (auto sym = findMangledSymbol(name)) {
+std::unique_ptr<llvm::TargetMachine> JIT::createTargetMachine() const {
+  return std::unique_ptr<llvm::TargetMachine>(selectTarget(options));
+}
+
+void JIT::printTargetInfo(llvm::raw_ostream& out) const {
+  out << "triple:    " << targetMachine->getTargetTriple().str() << '\n';
+  out << "cpu:       " << targetMachine->getTargetCPU() << '\n';
+  out << "features:";
+  
+  llvm::SmallVector<llvm::StringRef, 64> features;
+  targetMachine->getTargetFeatureString().split(features, ',', -1, false);
+  for (auto feature : features) {
+    // Only list the enabled features; the disabled ones are just noise.
+    if (feature.startswith("+")) out << ' ' << feature.drop_front();
+  }
+  out << '\n';
+  
+  auto const& targetOptions = targetMachine->Options;
+  out << "fp-fusion: "
+      << (targetOptions.AllowFPOpFusion == llvm::FPOpFusion::Fast ? "fast" : "standard")
+      << '\n';
+}
+
+std::unique_ptr<llvm::RuntimeDyld::SymbolResolver>
+JIT::createResolver(std::string const& scope) {
+  // Resolve symbols by looking back into the JIT.
+  return llvm::orc::createLambdaResolver(
+    [this, scope](std::string const& name) {
+      if (auto sym = findMangledSymbol(name, scope)) {
         return llvm::RuntimeDyld::SymbolInfo(sym.getAddress(), sym.getFlags());
       }
       return llvm::RuntimeDyld::SymbolInfo(nullptr);
     },
     [](std::string const&) { return nullptr; });
+}
+
+JIT::ModuleHandleT JIT::addModule(std::unique_ptr<llvm::Module> module,
+                                  std::string const& scope) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   
+  // We need a memory manager to allocate memory and resolve symbols for this
+  // new module.
   std::vector<std::unique_ptr<llvm::Module>> moduleSet;
   moduleSet.push_back(std::move(module));
   
+  PhaseTimer timer("codegen");
+  if (Timings::get().isEnabled()) {
+    timer.setDefinition(getFirstDefinitionName(*moduleSet.front()));
+  }
   auto moduleHandle = compileLayer.addModuleSet(
     std::move(moduleSet),
-    llvm::make_unique<llvm::SectionMemoryManager>(),
-    std::move(resolver));
+    llvm::make_unique<SlabMemoryManager>(slabAllocator),
+    createResolver(scope));
   
   moduleHandles.push_back(moduleHandle);
   return moduleHandle;
 }
 
+JIT::ModuleHandleT JIT::addObject(ObjectPtr object, std::string const& scope) {
+  std::vector<ObjectPtr> objectSet;
+  objectSet.push_back(std::move(object));
+  
+  auto moduleHandle = objectLayer.addObjectSet(
+    std::move(objectSet),
+    llvm::make_unique<SlabMemoryManager>(slabAllocator),
+    createResolver(scope));
+  
+  moduleHandles.push_back(moduleHandle);
+  return moduleHandle;
+}
+
+static char const implSuffix[] = "$impl";
+
+std::string JIT::getFirstDefinitionName(llvm::Module const& module) {
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) continue;
+    llvm::StringRef name = fn.getName();
+    if (name.endswith(implSuffix)) name = name.drop_back(sizeof(implSuffix) - 1);
+    return name;
+  }
+  return "";
+}
+
+std::vector<std::string> JIT::prepareDefinitions(llvm::Module& module) {
+  // Rename each definition so that its public name is free for the stub.
+  std::vector<std::string> names;
+  
+  for (auto& fn : module) {
+    if (fn.isDeclaration()) continue;
+    names.push_back(fn.getName());
+    fn.setName(names.back() + implSuffix);
+  }
+  
+  return names;
+}
+
+JIT::ModuleHandleT JIT::addDefinitions(std::unique_ptr<llvm::Module> module,
+                                       std::string const& scope) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  auto names = prepareDefinitions(*module);
+  auto moduleHandle = addModule(std::move(module), scope);
+  bindDefinitions(moduleHandle, names, scope);
+  return moduleHandle;
+}
+
+JIT::ModuleHandleT JIT::addDefinitionObject(ObjectPtr object,
+                                            std::vector<std::string> const& names,
+                                            std::string const& scope) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  auto moduleHandle = addObject(std::move(object), scope);
+  bindDefinitions(moduleHandle, names, scope);
+  return moduleHandle;
+}
+
+void JIT::bindDefinitions(ModuleHandleT moduleHandle,
+                          std::vector<std::string> const& names,
+                          std::string const& scope) {
+  std::vector<ModuleHandleT> superseded;
+  // Looking up the first definition finalizes the module.
+  PhaseTimer timer("link", names.empty() ? "" : names.front());
+  
+  for (auto const& name : names) {
+    auto impl = compileLayer.findSymbolIn(moduleHandle, mangle(name + implSuffix), true);
+    assert(impl && "definition not found");
+    
+    auto mangledName = scope + mangle(name);
+    llvm::Error err = stubsManager->findStub(mangledName, true)
+      ? stubsManager->updatePointer(mangledName, impl.getAddress())
+      : stubsManager->createStub(mangledName, impl.getAddress(),
+                                 llvm::JITSymbolFlags::Exported);
+    if (err) {
+      llvm::logAllUnhandledErrors(std::move(err), llvm::errs(), "");
+      fatalError("failed to bind '", name, "' to its new definition");
+    }
+    timer.stop();
+    
+    auto iterator = definitionModules.find(scope + name);
+    if (iterator != definitionModules.end()) {
+      superseded.push_back(iterator->second);
+      iterator->second = moduleHandle;
+    } else {
+      definitionModules.emplace(scope + name, moduleHandle);
+    }
+  }
+  
+  // All calls go through the stubs, so nothing references a superseded
+  // definition anymore. Free its module once none of its definitions is live.
+  for (auto handle : superseded) {
+    bool isLive = std::any_of(definitionModules.begin(), definitionModules.end(),
+      [&](std::pair<std::string const, ModuleHandleT> const& entry) {
+        return entry.second == handle;
+      });
+    bool isRemoved = std::find(moduleHandles.begin(), moduleHandles.end(),
+                               handle) == moduleHandles.end();
+    if (!isLive && !isRemoved) removeModule(handle);
+  }
+}
+
 void JIT::removeModule(ModuleHandleT moduleHandle) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
   moduleHandles.erase(
     std::find(moduleHandles.begin(), moduleHandles.end(), moduleHandle));
+  codeMap.remove(&*moduleHandle);
+  if (gdbRegistrar) gdbRegistrar->remove(&*moduleHandle);
   compileLayer.removeModuleSet(moduleHandle);
 }
 
-llvm::orc::JITSymbol JIT::findSymbol(std::string const& name) {
-  return findMangledSymbol(mangle(name));
+void JIT::removeScope(std::string const& scope) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  std::vector<ModuleHandleT> handles;
+  
+  for (auto iterator = definitionModules.begin();
+       iterator != definitionModules.end();) {
+    if (llvm::StringRef(iterator->first).startswith(scope)) {
+      handles.push_back(iterator->second);
+      iterator = definitionModules.erase(iterator);
+    } else {
+      ++iterator;
+    }
+  }
+  
+  // A module may hold several of the definitions.
+  for (auto handle : handles) {
+    if (std::find(moduleHandles.begin(), moduleHandles.end(), handle) !=
+        moduleHandles.end()) {
+      removeModule(handle);
+    }
+  }
+}
+
+llvm::orc::JITSymbol JIT::findSymbol(std::string const& name,
+                                     std::string const& scope) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  return findMangledSymbol(mangle(name), scope);
+}
+
+llvm::orc::TargetAddress JIT::getSymbolAddressIn(ModuleHandleT moduleHandle,
+                                                 std::string const& name) {
+  // Finalizing the module modifies the JIT, so it has to happen under the
+  // lock rather than lazily in the caller.
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  PhaseTimer timer("link", name);
+  if (auto sym = compileLayer.findSymbolIn(moduleHandle, mangle(name), true)) {
+    return sym.getAddress();
+  }
+  return 0;
+}
+
+JITMemoryUsage JIT::getMemoryUsage() const {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  return {moduleHandles.size(), slabAllocator.getUsedBytes(),
+          slabAllocator.getMappedBytes()};
 }
 
 std::string JIT::mangle(std::string const& name) {
@@ -59,7 +280,64 @@ std::string JIT::mangle(std::string const& name) {
   return mangledName;
 }
 
-llvm::orc::JITSymbol JIT::findMangledSymbol(std::string const& name) {
+std::string JIT::getSourceName(llvm::StringRef symbolName) const {
+  char prefix = dataLayout.getGlobalPrefix();
+  if (prefix && symbolName.startswith(llvm::StringRef(&prefix, 1))) {
+    symbolName = symbolName.drop_front();
+  }
+  if (symbolName.endswith(implSuffix)) {
+    symbolName = symbolName.drop_back(sizeof(implSuffix) - 1);
+  }
+  return symbolName;
+}
+
+void JIT::notifyLoaded(void const* owner, llvm::object::ObjectFile const& object,
+                       llvm::RuntimeDyld::LoadedObjectInfo const& info) {
+  // The debug object is a copy of the object with its sections at their
+  // load addresses, so its symbols have their final addresses. Not all
+  // object formats provide one.
+  auto debugObject = info.getObjectForDebug(object);
+  if (!debugObject.getBinary()) return;
+  
+  for (auto const& symbolAndSize :
+       llvm::object::computeSymbolSizes(*debugObject.getBinary())) {
+    auto const& symbol = symbolAndSize.first;
+    auto type = symbol.getType();
+    if (!type) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+    if (*type != llvm::object::SymbolRef::ST_Function) continue;
+    
+    auto name = symbol.getName();
+    auto address = symbol.getAddress();
+    if (!name || !address) {
+      llvm::consumeError(name.takeError());
+      llvm::consumeError(address.takeError());
+      continue;
+    }
+    std::string sourceName = getSourceName(*name);
+    if (perfMap) perfMap->add(*address, symbolAndSize.second, sourceName);
+    codeMap.add(owner, *address, symbolAndSize.second, std::move(sourceName));
+  }
+  
+  if (gdbRegistrar) gdbRegistrar->add(owner, std::move(debugObject));
+}
+
+llvm::orc::JITSymbol JIT::findMangledSymbol(std::string const& name,
+                                            std::string const& scope) {
+  // Functions added with addDefinitions() are always bound through their
+  // stubs, so that callers see later redefinitions. The scope's own
+  // definitions take precedence over the unscoped ones.
+  if (!scope.empty()) {
+    if (auto stub = stubsManager->findStub(scope + name, true)) {
+      return stub;
+    }
+  }
+  if (auto stub = stubsManager->findStub(name, true)) {
+    return stub;
+  }
+  
   // Search modules in reverse order: from last added to first added.
   // This is the opposite of the usual search order for dlsym, but makes more
   // sense in a REPL where we want to bind to the newest available definition.
@@ -2,38 +2,153 @@
 #define EAX_JIT_H
 
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h>
 #include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/IndirectionUtils.h>
+#include <llvm/Object/ObjectFile.h>
+
+#include "code_map.h"
+#include "gdb_registrar.h"
+#include "memory_manager.h"
+#include "perf_map.h"
 
 namespace eax {
 
+/// Options affecting the machine code generated by the JIT.
+struct JITOptions {
+  bool targetHostCPU = false; // Use the host CPU name and feature set.
+  bool fuseFPOps = false; // Allow forming fused multiply-adds.
+  bool unsafeFPMath = false;
+  bool noNaNsFPMath = false;
+  bool noInfsFPMath = false;
+  bool writePerfMap = false; // Write /tmp/perf-<pid>.map for perf.
+  bool registerWithDebugger = false; // Use the GDB JIT interface.
+};
+
+/// The memory held by the JIT for compiled code and data.
+struct JITMemoryUsage {
+  size_t modules;
+  size_t usedBytes; // Held by live modules.
+  size_t mappedBytes; // Including freed memory kept for reuse.
+};
+
 /// A simple JIT compiler, based on Kaleidoscope JIT
 /// (https://llvm.org/svn/llvm-project/llvm/trunk/examples/Kaleidoscope/include/KaleidoscopeJIT.h)
+///
+/// The JIT can be used from multiple threads. Definitions are bound in a
+/// scope, given as a prefix for their names, so that independent sessions
+/// can define functions with the same name. Code added in a scope calls the
+/// definitions of that scope first, and then the unscoped ones.
 class JIT {
+  /// Passes each object the object layer loads to JIT::notifyLoaded().
+  struct LoadListener {
+    JIT* jit;
+    
+    template<typename HandleT, typename ObjectSetT, typename LoadedObjectInfosT>
+    void operator()(HandleT handle, ObjectSetT const& objects,
+                    LoadedObjectInfosT const& infos) const {
+      for (size_t i = 0; i < objects.size(); ++i) {
+        jit->notifyLoaded(&*handle, *objects[i]->getBinary(), *infos[i]);
+      }
+    }
+  };
+  
 public:
-  using ObjLayerT = llvm::orc::ObjectLinkingLayer<>;
+  using ObjLayerT = llvm::orc::ObjectLinkingLayer<LoadListener>;
   using CompileLayerT = llvm::orc::IRCompileLayer<ObjLayerT>;
   using ModuleHandleT = CompileLayerT::ModuleSetHandleT;
+  using ObjectPtr = std::unique_ptr<llvm::object::OwningBinary<llvm::object::ObjectFile>>;
   
 public:
-  JIT();
+  JIT(JITOptions const& options = JITOptions());
   llvm::TargetMachine& getTargetMachine() { return *targetMachine; }
-  ModuleHandleT addModule(std::unique_ptr<llvm::Module>);
+  
+  /// Creates a new target machine with the same configuration as the JIT's,
+  /// e.g. for compiling modules on another thread.
+  std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+  
+  /// Prints the target triple, CPU and enabled features the JIT generates
+  /// code for.
+  void printTargetInfo(llvm::raw_ostream& out) const;
+  
+  ModuleHandleT addModule(std::unique_ptr<llvm::Module>,
+                          std::string const& scope = "");
+  
+  /// Adds a module of function definitions. Each function is called through
+  /// an indirection stub, so that redefining it later only has to update the
+  /// stub's pointer to rebind all earlier callers. Modules whose definitions
+  /// have all been superseded this way are removed.
+  ModuleHandleT addDefinitions(std::unique_ptr<llvm::Module>,
+                               std::string const& scope = "");
+  
+  /// Renames the functions defined in a module that is compiled outside the
+  /// JIT, so that the resulting object can be passed to addDefinitionObject().
+  /// Returns the original names of the functions.
+  static std::vector<std::string> prepareDefinitions(llvm::Module&);
+  
+  /// Returns the original name of the first function defined in a module,
+  /// e.g. to attribute the time spent compiling it.
+  static std::string getFirstDefinitionName(llvm::Module const&);
+  
+  /// Like addDefinitions(), but for an already compiled module.
+  ModuleHandleT addDefinitionObject(ObjectPtr, std::vector<std::string> const& names,
+                                    std::string const& scope = "");
   void removeModule(ModuleHandleT);
-  llvm::orc::JITSymbol findSymbol(std::string const& name);
+  
+  /// Removes the modules of all definitions in the given scope. Their stubs
+  /// stay allocated, so the scope must not be used again.
+  void removeScope(std::string const& scope);
+  
+  llvm::orc::JITSymbol findSymbol(std::string const& name,
+                                  std::string const& scope = "");
+  
+  /// Returns the address of a symbol defined in the given module, or 0 if
+  /// there isn't one. The module is finalized first if necessary.
+  llvm::orc::TargetAddress getSymbolAddressIn(ModuleHandleT, std::string const& name);
+  JITMemoryUsage getMemoryUsage() const;
+  
+  /// Returns the address ranges of the functions in the loaded objects.
+  CodeMap const& getCodeMap() const { return codeMap; }
   
 private:
+  std::unique_ptr<llvm::RuntimeDyld::SymbolResolver> createResolver(std::string const& scope);
+  ModuleHandleT addObject(ObjectPtr, std::string const& scope);
+  void bindDefinitions(ModuleHandleT, std::vector<std::string> const& names,
+                       std::string const& scope);
   std::string mangle(std::string const& name);
-  llvm::orc::JITSymbol findMangledSymbol(std::string const& name);
+  
+  /// Returns the name of the eax function a symbol belongs to.
+  std::string getSourceName(llvm::StringRef symbolName) const;
+  
+  /// Records the functions of a loaded object, and announces them to
+  /// profilers and debuggers if enabled. "owner" identifies the set of
+  /// objects the object was added in.
+  void notifyLoaded(void const* owner, llvm::object::ObjectFile const& object,
+                    llvm::RuntimeDyld::LoadedObjectInfo const& info);
+  llvm::orc::JITSymbol findMangledSymbol(std::string const& name,
+                                         std::string const& scope);
   
 private:
+  JITOptions const options;
   std::unique_ptr<llvm::TargetMachine> targetMachine;
   llvm::DataLayout const dataLayout;
+  SlabAllocator slabAllocator; // Must outlive the memory managers in objectLayer.
   ObjLayerT objectLayer;
   CompileLayerT compileLayer;
+  std::unique_ptr<llvm::orc::IndirectStubsManager> stubsManager;
   std::vector<ModuleHandleT> moduleHandles;
+  std::unordered_map<std::string, ModuleHandleT> definitionModules; // By scoped name.
+  CodeMap codeMap;
+  std::unique_ptr<PerfMap> perfMap; // If options.writePerfMap.
+  std::unique_ptr<GDBRegistrar> gdbRegistrar; // If options.registerWithDebugger.
+  
+  /// Guards all of the above. Recursive, since modules are finalized, and
+  /// resolve their symbols through the JIT, within the JIT's own calls.
+  mutable std::recursive_mutex mutex;
 };
 
 }
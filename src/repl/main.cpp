@@ -1,108 +1,451 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
-#include <llvm/IR/Function.h>
-#include <llvm/IR/Module.h>
-#include <llvm/IR/LLVMContext.h>
+#include <sstream>
+#include <thread>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/TargetSelect.h>
-#include <llvm/Transforms/Scalar.h>
-#include "llvm/Transforms/Scalar/GVN.h"
+#include <llvm/Support/raw_ostream.h>
 
-#include "jit.h"
+#include "engine.h"
+#include "batch_compiler.h"
+#include "expr_benchmark.h"
+#include "result_writer.h"
+#include "sampling_profiler.h"
+#include "server.h"
+#include "session.h"
+#include "snapshot.h"
 #include "../ast/function.h"
 #include "../ast/ast_printer.h"
 #include "../parser/lexer.h"
-#include "../ir_gen/ir_gen.h"
+#include "../parser/script_parser.h"
+#include "../util/build_info.h"
+#include "../util/call_profiler.h"
 #include "../util/error.h"
+#include "../util/metrics.h"
+#include "../util/pgo_profile.h"
+#include "../util/timings.h"
 
 using namespace eax;
+namespace cl = llvm::cl;
 
-static std::unique_ptr<JIT> jit;
+static cl::OptionCategory eaxCategory("eax options");
+static cl::opt<bool> targetHostCPU("host-cpu",
+  cl::desc("Generate code for the exact host CPU and its features"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> fpContract("fp-contract",
+  cl::desc("Allow contracting floating-point operations, e.g. into FMAs"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> fpReassoc("fp-reassoc",
+  cl::desc("Allow reassociating floating-point operations"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> fpNoNaNs("fp-no-nans",
+  cl::desc("Assume floating-point values are never NaN"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> fpNoInfs("fp-no-infs",
+  cl::desc("Assume floating-point values are never infinite"),
+  cl::cat(eaxCategory));
+static cl::opt<unsigned> exprCacheSize("expr-cache-size",
+  cl::desc("Number of compiled top-level expressions to keep (default 256)"),
+  cl::init(256), cl::cat(eaxCategory));
+static cl::opt<std::string> scriptFile(cl::Positional,
+  cl::desc("[script]"), cl::cat(eaxCategory));
+static cl::opt<bool> batchMode("batch",
+  cl::desc("Run standard input as a script, without prompts"),
+  cl::cat(eaxCategory));
+static cl::opt<unsigned> numCompileThreads("j",
+  cl::desc("Number of threads compiling definitions of a script "
+           "(default: number of cores)"),
+  cl::init(0), cl::cat(eaxCategory));
+static cl::opt<bool> printTargetInfo("print-target-info",
+  cl::desc("Print the effective target CPU and features at startup"),
+  cl::cat(eaxCategory));
+static cl::opt<unsigned> verbosity("verbosity",
+  cl::desc("Level of diagnostic output (1: print the optimized IR of "
+           "each definition entered at the prompt)"),
+  cl::value_desc("level"), cl::init(0), cl::cat(eaxCategory));
+static cl::opt<std::string> preludeFile("prelude",
+  cl::desc("Load definitions shared by all sessions from a file"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<std::string> preludeSnapshotFile("prelude-snapshot",
+  cl::desc("Cache the compiled prelude in a file, and load it from there "
+           "while the prelude, the eax build and the target are unchanged"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<std::string> listenPath("listen",
+  cl::desc("Serve evaluation requests on a Unix domain socket"),
+  cl::value_desc("path"), cl::cat(eaxCategory));
+enum TimingsFormat { NoTimings, TimingsTable, TimingsJSON };
+static cl::opt<TimingsFormat> timingsFormat("timings",
+  cl::desc("Time each compilation phase and print a report at exit"),
+  cl::values(clEnumValN(TimingsTable, "table", "Print a table"),
+             clEnumValN(TimingsJSON, "json", "Print JSON"),
+             clEnumValEnd),
+  cl::init(NoTimings), cl::cat(eaxCategory));
+static cl::opt<bool> profileCalls("profile-calls",
+  cl::desc("Count the calls of each function and the cycles spent in it; "
+           "print the profile with :profile"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> keepFramePointers("frame-pointers",
+  cl::desc("Keep frame pointers in generated code, so that the sampling "
+           "profiler records whole call stacks"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> writePerfMap("perf-map",
+  cl::desc("Write the symbols of generated code to /tmp/perf-<pid>.map "
+           "for perf"),
+  cl::cat(eaxCategory));
+static cl::opt<bool> registerWithDebugger("gdb-jit",
+  cl::desc("Register generated code with debuggers through the GDB JIT "
+           "interface"),
+  cl::cat(eaxCategory));
+static cl::opt<unsigned> sampleFrequency("sample-frequency",
+  cl::desc("Samples per second of CPU time taken by the sampling profiler "
+           "(default 1000)"),
+  cl::init(1000), cl::cat(eaxCategory));
+static cl::opt<std::string> sampleFoldedFile("sample-folded",
+  cl::desc("Sample the whole run, and write the call stacks in the folded "
+           "format of flame graph tools to a file"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<std::string> metricsFile("metrics-file",
+  cl::desc("Write the metrics to a file in the Prometheus text format, "
+           "periodically and at exit"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<unsigned> metricsInterval("metrics-interval",
+  cl::desc("Seconds between writes of the metrics file (default 15)"),
+  cl::init(15), cl::cat(eaxCategory));
+static cl::opt<std::string> pgoGenerateFile("pgo-generate",
+  cl::desc("Count the calls and branches of the defined functions, and write "
+           "them to a profile file at exit, for -pgo-use"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<std::string> pgoUseFile("pgo-use",
+  cl::desc("Optimize the functions that haven't changed since a profile "
+           "file was written with -pgo-generate, using their counts"),
+  cl::value_desc("file"), cl::cat(eaxCategory));
+static cl::opt<ResultFormat> outputFormat("output-format",
+  cl::desc("Format of the values of top-level expressions (default text)"),
+  cl::values(clEnumValN(ResultFormat::Text, "text", "One value per line"),
+             clEnumValN(ResultFormat::CSV, "csv",
+                        "One row per line, tuple elements as columns"),
+             clEnumValN(ResultFormat::Binary, "binary",
+                        "Raw doubles in native byte order"),
+             clEnumValEnd),
+  cl::init(ResultFormat::Text), cl::cat(eaxCategory));
+
+static std::unique_ptr<Snapshot> preludeSnapshot; // Must outlive the engine.
+static std::unique_ptr<Profile> pgoProfile; // Must outlive the engine.
+static std::unique_ptr<Engine> engine;
+static std::unique_ptr<Session> replSession; // The session of the prompt or script.
+static std::unique_ptr<BatchCompiler> batchCompiler;
+static std::unique_ptr<SamplingProfiler> samplingProfiler; // Created on demand.
+static std::unique_ptr<MetricsFileWriter> metricsFileWriter;
+static std::unique_ptr<ResultWriter> resultWriter;
 static Lexer lexer;
-static llvm::LLVMContext llvmContext;
-static IrGen irgen(llvmContext);
 static AstPrinter printer(std::cout);
-static std::unique_ptr<llvm::Module> globalModule;
-static std::unique_ptr<llvm::legacy::FunctionPassManager> fnPassManager;
 
-static void initModuleAndFnPassManager() {
-  globalModule = llvm::make_unique<llvm::Module>("eaxjit", llvmContext);
-  globalModule->setDataLayout(jit->getTargetMachine().createDataLayout());
-  
-  fnPassManager = llvm::make_unique<llvm::legacy::FunctionPassManager>(globalModule.get());
-  // Promote allocas to registers.
-  fnPassManager->add(llvm::createPromoteMemoryToRegisterPass());
-  // Do simple "peephole" and bit-twiddling  optimizations.
-  fnPassManager->add(llvm::createInstructionCombiningPass());
-  // Reassociate expressions.
-  fnPassManager->add(llvm::createReassociatePass());
-  // Eliminate common subexpressions.
-  fnPassManager->add(llvm::createGVNPass());
-  // Simplify the control flow graph (deleting unreachable blocks, etc.).
-  fnPassManager->add(llvm::createCFGSimplificationPass());
-  fnPassManager->doInitialization();
-  
-  irgen.setModule(*globalModule);
-  irgen.setFnPassManager(*fnPassManager);
+static JITOptions getJITOptions() {
+  JITOptions options;
+  options.targetHostCPU = targetHostCPU;
+  options.fuseFPOps = fpContract;
+  options.unsafeFPMath = fpReassoc;
+  options.noNaNsFPMath = fpNoNaNs;
+  options.noInfsFPMath = fpNoInfs;
+  options.writePerfMap = writePerfMap;
+  options.registerWithDebugger = registerWithDebugger;
+  return options;
 }
 
-static std::string evaluate(llvm::orc::TargetAddress addr, llvm::Type* type) {
-  if (type == llvm::Type::getInt1Ty(llvmContext)) {
-    return (reinterpret_cast<bool(*)()>(addr)() ? "true" : "false");
-  }
-  if (type == llvm::Type::getDoubleTy(llvmContext)) {
-    return std::to_string(reinterpret_cast<double(*)()>(addr)());
-  }
-  std::string typeName;
-  llvm::raw_string_ostream stream(typeName);
-  type->print(stream);
-  return "unknown type '" + stream.str() + "'";
+static llvm::FastMathFlags getFastMathFlags() {
+  // LLVM has no separate flags for contraction and reassociation; both are
+  // covered by "unsafe algebra". Contraction into FMAs is additionally
+  // controlled by the target options, see getJITOptions().
+  llvm::FastMathFlags flags;
+  if (fpReassoc) flags.setUnsafeAlgebra();
+  if (fpNoNaNs) flags.setNoNaNs();
+  if (fpNoInfs) flags.setNoInfs();
+  return flags;
+}
+
+static SessionOptions getSessionOptions() {
+  SessionOptions options;
+  options.fastMathFlags = getFastMathFlags();
+  options.exprCacheSize = exprCacheSize;
+  options.printIR = verbosity >= 1;
+  options.profileCalls = profileCalls;
+  options.keepFramePointers = keepFramePointers;
+  options.pgoInstrument = !pgoGenerateFile.empty();
+  options.pgoProfile = pgoProfile.get();
+  return options;
 }
 
 static void handleFnDefinition() {
   if (auto fn = lexer.parseFnDefinition()) {
-    fn->accept(irgen);
-    if (auto ir = irgen.getResult()) {
-      ir->dump();
-      jit->addModule(std::move(globalModule));
-      initModuleAndFnPassManager();
-    }
+    replSession->define(std::move(fn));
   } else {
     lexer.nextToken(); // Skip token for error recovery.
   }
 }
 
+/// Runs "fn", and prints the diagnostics it reports after the results that
+/// are still buffered, so that each error appears among the results of the
+/// expressions around it. Error-free code costs no flushes.
+template<typename Fn>
+static void runWithOrderedDiagnostics(Fn fn) {
+  static std::ostringstream diagnostics; // Reused, since this runs per expression.
+  std::ostream* previousStream = diagnosticStream();
+  diagnosticStream() = &diagnostics;
+  fn();
+  diagnosticStream() = previousStream;
+  
+  if (diagnostics.tellp() > 0) {
+    resultWriter->flush();
+    *previousStream << diagnostics.str();
+    diagnostics.str("");
+  }
+}
+
+static void evaluateToplevelExpr(Session& session, Function& fn) {
+  EvalResult result;
+  if (session.evaluate(fn, result)) {
+    resultWriter->write(result);
+  }
+}
+
 static void handleToplevelExpr() {
   // Evaluate a top-level expression into an anonymous function.
   if (auto fn = lexer.parseToplevelExpr()) {
-    fn->accept(irgen);
-    if (auto ir = irgen.getResult()) {
-      // Get the type of the expression.
-      llvm::Type* type = ir->getType()->getPointerElementType();
-      type = llvm::cast<llvm::FunctionType>(type)->getReturnType();
-      
-      // JIT the module containing the anonymous expression,
-      // keeping a handle so we can free it later.
-      auto moduleHandle = jit->addModule(std::move(globalModule));
-      initModuleAndFnPassManager();
-      
-      auto exprSym = jit->findSymbol("__anon_expr");
-      assert(exprSym && "function not found");
-      
-      std::cout << evaluate(exprSym.getAddress(), type)
-                << std::endl;
-      
-      // Delete the anonymous expression module from the JIT.
-      jit->removeModule(moduleHandle);
-    }
+    evaluateToplevelExpr(*replSession, *fn);
+    resultWriter->flush();
   } else {
     lexer.nextToken(); // Skip token for error recovery.
   }
 }
 
+static void printMemoryUsage(Session& session) {
+  JITMemoryUsage usage = engine->getJIT().getMemoryUsage();
+  std::cout << "definitions:  " << session.getNumDefinitions() << '\n'
+            << "cached exprs: " << session.getNumCachedExprs() << '\n'
+            << "modules:      " << usage.modules << '\n'
+            << "JIT memory:   " << usage.usedBytes / 1024 << " KiB in use, "
+            << usage.mappedBytes / 1024 << " KiB mapped" << std::endl;
+}
+
+/// Handles ":timings [on|off|json|reset]". Without an argument, prints the
+/// timings as a table.
+static void handleTimingsCommand(Session& session) {
+  Timings& timings = Timings::get();
+  std::string argument;
+  if (lexer.nextToken() == TokenIdentifier) argument = lexer.getIdentifier();
+  
+  if (argument == "on" || argument == "off") {
+    timings.setEnabled(argument == "on");
+  } else if (argument == "reset") {
+    timings.reset();
+  } else if (argument.empty() || argument == "json") {
+    // Include the definitions still being compiled.
+    session.linkCompiledDefinitions(true);
+    if (argument.empty()) timings.printTable(std::cout);
+    else timings.printJSON(std::cout);
+  } else {
+    error("expected 'on', 'off', 'json' or 'reset' after ':timings'");
+  }
+}
+
+/// Handles ":profile [reset]". Without an argument, prints the call profile.
+static void handleProfileCommand() {
+  if (lexer.nextToken() == TokenIdentifier && lexer.getIdentifier() == "reset") {
+    CallProfiler::get().reset();
+  } else if (lexer.getCurrentToken() != '\n' && lexer.getCurrentToken() != TokenEof) {
+    error("expected 'reset' or nothing after ':profile'");
+  } else if (!profileCalls) {
+    error("the call profile is only recorded with -profile-calls");
+  } else {
+    CallProfiler::get().printProfile(std::cout);
+  }
+}
+
+static SamplingProfiler& getSamplingProfiler() {
+  if (!samplingProfiler) {
+    samplingProfiler = llvm::make_unique<SamplingProfiler>(
+      engine->getJIT().getCodeMap());
+  }
+  return *samplingProfiler;
+}
+
+/// Handles ":sample [start|stop|graph|folded|reset]". Without an argument,
+/// prints the flat profile.
+static void handleSampleCommand() {
+  SamplingProfiler& profiler = getSamplingProfiler();
+  std::string argument;
+  if (lexer.nextToken() == TokenIdentifier) argument = lexer.getIdentifier();
+  
+  if (argument == "start") {
+    profiler.start(sampleFrequency);
+  } else if (argument == "stop") {
+    profiler.stop();
+  } else if (argument == "reset") {
+    profiler.reset();
+  } else if (argument.empty()) {
+    profiler.printFlatProfile(std::cout);
+  } else if (argument == "graph") {
+    profiler.printCallGraph(std::cout);
+  } else if (argument == "folded") {
+    profiler.printFoldedStacks(std::cout);
+  } else {
+    error("expected 'start', 'stop', 'graph', 'folded' or 'reset' after ':sample'");
+  }
+}
+
+/// Handles ":metrics [prometheus]". Without an argument, prints the metrics
+/// as a table.
+static void handleMetricsCommand(Session& session) {
+  std::string argument;
+  if (lexer.nextToken() == TokenIdentifier) argument = lexer.getIdentifier();
+  
+  if (argument.empty() || argument == "prometheus") {
+    session.linkCompiledDefinitions(true);
+    if (argument.empty()) Metrics::get().printTable(std::cout);
+    else Metrics::get().printPrometheus(std::cout);
+  } else {
+    error("expected 'prometheus' or nothing after ':metrics'");
+  }
+}
+
+/// Handles the commands that show what the compiler makes of a definition:
+/// ":ir [before] name" prints its IR after or before optimization, ":asm name"
+/// its machine code, ":passes name" its size after each optimization pass,
+/// and ":remarks name" the remarks of the optimization passes.
+static void handleInspectCommand(Session& session, std::string command) {
+  bool before = false;
+  std::string name;
+  if (lexer.nextToken() == TokenIdentifier) name = lexer.getIdentifier();
+  if (command == "ir" && name == "before" && lexer.nextToken() == TokenIdentifier) {
+    before = true;
+    name = lexer.getIdentifier();
+  }
+  if (name.empty()) {
+    error("expected a function name after ':", command, "'");
+    return;
+  }
+  
+  CodeInspection inspection;
+  session.linkCompiledDefinitions(true);
+  if (!session.inspect(name, inspection)) return;
+  
+  if (command == "ir") {
+    std::cout << (before ? inspection.unoptimizedIR : inspection.optimizedIR);
+  } else if (command == "asm") {
+    std::cout << inspection.assembly << "; " << inspection.codeSize
+              << " bytes of machine code\n";
+  } else if (command == "passes") {
+    printPassStatistics(std::cout, inspection.passStatistics);
+  } else if (inspection.remarks.empty()) {
+    std::cout << "no remarks\n";
+  } else {
+    std::cout << inspection.remarks;
+  }
+  std::cout.flush();
+}
+
+/// Handles ":bench [calls] expr": compiles the expression, and then calls it
+/// repeatedly and prints the distribution of the time per call. A leading
+/// number is taken as the number of calls; otherwise, the expression runs
+/// for about a second.
+static void handleBenchCommand(Session& session) {
+  uint64_t calls = 0;
+  if (lexer.nextToken() == TokenNumber) {
+    double number = lexer.getNumber();
+    if (number < 1 || number != uint64_t(number)) {
+      error("expected a positive integer number of calls");
+      return;
+    }
+    calls = uint64_t(number);
+    lexer.nextToken();
+  }
+  
+  auto fn = lexer.parseToplevelExpr();
+  if (!fn) return;
+  
+  auto compileStart = std::chrono::steady_clock::now();
+  auto compiled = session.compile(*fn);
+  if (!compiled) return;
+  std::chrono::duration<double, std::milli> compileTime =
+    std::chrono::steady_clock::now() - compileStart;
+  
+  auto result = benchmarkExpr(compiled->address, compiled->type, calls);
+  auto flags = std::cout.flags();
+  auto precision = std::cout.precision();
+  std::cout << "compile:    " << std::fixed << std::setprecision(3)
+            << compileTime.count() << " ms (including link)" << std::endl;
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+  printExprBenchmarkResult(std::cout, result);
+}
+
+static void runScript(Session& session, llvm::StringRef source);
+
+/// Handles ":load file", which runs a script in the session. Running a
+/// changed version of a script again only recompiles the definitions that
+/// changed, and the functions that call them if their signatures changed.
+static void handleLoadCommand(Session& session) {
+  auto path = llvm::StringRef(lexer.readLine()).trim().str();
+  if (path.empty()) {
+    error("expected a file name after ':load'");
+    return;
+  }
+  
+  auto source = llvm::MemoryBuffer::getFile(path);
+  if (!source) {
+    error("couldn't read '", path, "': ", source.getError().message());
+    return;
+  }
+  
+  // The commands of the script use the lexer too.
+  Lexer previousLexer = lexer;
+  runScript(session, (*source)->getBuffer());
+  lexer = previousLexer;
+}
+
+/// Handles a REPL command of the form ":name ...".
+static void handleCommand(Session& session) {
+  if (lexer.nextToken() != TokenIdentifier) {
+    error("expected a command name after ':'");
+  } else if (lexer.getIdentifier() == "memory") {
+    session.linkCompiledDefinitions(true);
+    printMemoryUsage(session);
+  } else if (lexer.getIdentifier() == "timings") {
+    handleTimingsCommand(session);
+  } else if (lexer.getIdentifier() == "profile") {
+    handleProfileCommand();
+  } else if (lexer.getIdentifier() == "sample") {
+    handleSampleCommand();
+  } else if (lexer.getIdentifier() == "bench") {
+    handleBenchCommand(session);
+  } else if (lexer.getIdentifier() == "metrics") {
+    handleMetricsCommand(session);
+  } else if (lexer.getIdentifier() == "ir" || lexer.getIdentifier() == "asm" ||
+             lexer.getIdentifier() == "passes" || lexer.getIdentifier() == "remarks") {
+    handleInspectCommand(session, lexer.getIdentifier());
+  } else if (lexer.getIdentifier() == "load") {
+    handleLoadCommand(session);
+    return; // The rest of the line has been read.
+  } else {
+    error("unknown command ':", lexer.getIdentifier(), "'");
+  }
+  
+  // Skip the rest of the line.
+  while (lexer.getCurrentToken() != '\n' && lexer.getCurrentToken() != TokenEof) {
+    lexer.nextToken();
+  }
+}
+
 static void mainInterpreterLoop() {
   std::cout << std::setfill('0');
   
   for (int count = 0;; ++count) {
+    replSession->linkCompiledDefinitions(false);
     std::cout << "\e[2m" << std::setw(3) << count << ">\e[22m ";
     
     switch (lexer.nextToken()) {
@@ -113,6 +456,9 @@ static void mainInterpreterLoop() {
     case TokenDef:
       handleFnDefinition();
       break;
+    case ':':
+      handleCommand(*replSession);
+      break;
     default:
       handleToplevelExpr();
       break;
@@ -120,13 +466,153 @@ static void mainInterpreterLoop() {
   }
 }
 
+static unsigned getNumCompileThreads() {
+  unsigned numThreads = numCompileThreads;
+  if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+  return numThreads;
+}
+
+/// Runs a script in the given session without prompting. The script is
+/// parsed in parallel, and consecutive definitions are compiled in parallel;
+/// they are linked before any following expression or command is run.
+static void runScript(Session& session, llvm::StringRef source) {
+  unsigned numThreads = getNumCompileThreads();
+  if (!batchCompiler) {
+    batchCompiler = llvm::make_unique<BatchCompiler>(engine->getJIT(), numThreads);
+  }
+  
+  std::vector<std::unique_ptr<Function>> pendingDefinitions;
+  
+  for (auto& item : parseScript(source, numThreads)) {
+    if (item.kind == ScriptItem::Definition) {
+      pendingDefinitions.push_back(std::move(item.fn));
+      continue;
+    }
+    
+    runWithOrderedDiagnostics([&] {
+      session.define(pendingDefinitions, *batchCompiler);
+    });
+    if (!item.diagnostics.empty()) {
+      resultWriter->flush();
+      std::cerr << item.diagnostics;
+    }
+    
+    switch (item.kind) {
+    case ScriptItem::Expression:
+      runWithOrderedDiagnostics([&] { evaluateToplevelExpr(session, *item.fn); });
+      break;
+    case ScriptItem::Command:
+      // Commands print to standard output too.
+      resultWriter->flush();
+      lexer.setInput(item.command);
+      handleCommand(session);
+      break;
+    default:
+      break;
+    }
+  }
+  
+  runWithOrderedDiagnostics([&] {
+    session.define(pendingDefinitions, *batchCompiler);
+    session.linkCompiledDefinitions(true);
+  });
+  resultWriter->flush();
+}
+
+static std::unique_ptr<llvm::MemoryBuffer> readFile(std::string const& path) {
+  auto buffer = llvm::MemoryBuffer::getFileOrSTDIN(path);
+  if (!buffer) fatalError("couldn't read '", path, "': ",
+                          buffer.getError().message());
+  return std::move(*buffer);
+}
+
+/// Loads the prelude into the prelude session: from the snapshot if it's up
+/// to date, or else by running the prelude and then writing the snapshot.
+static void loadPrelude() {
+  auto source = readFile(preludeFile);
+  Session& prelude = engine->getPrelude();
+  
+  // Instrumented code refers to the addresses of this process's counters,
+  // so it can't be snapshotted.
+  if (preludeSnapshotFile.empty() || !pgoGenerateFile.empty()) {
+    runScript(prelude, source->getBuffer());
+    return;
+  }
+  
+  // The object code depends on the eax and LLVM build, on the target, on the
+  // floating-point options and on the PGO profile.
+  std::string target;
+  llvm::raw_string_ostream targetStream(target);
+  engine->getJIT().printTargetInfo(targetStream);
+  targetStream << "fp-flags:  " << fpReassoc << fpNoNaNs << fpNoInfs
+               << "\nprofiling: " << profileCalls << keepFramePointers;
+  std::unique_ptr<llvm::MemoryBuffer> profileSource;
+  if (!pgoUseFile.empty()) profileSource = readFile(pgoUseFile);
+  uint64_t key = Snapshot::computeKey({getBuildID(), source->getBuffer(),
+                                       targetStream.str(),
+                                       profileSource ? profileSource->getBuffer() : ""});
+  
+  if ((preludeSnapshot = Snapshot::read(preludeSnapshotFile, key))) {
+    prelude.loadSnapshot(*preludeSnapshot);
+    return;
+  }
+  
+  preludeSnapshot = llvm::make_unique<Snapshot>();
+  prelude.setSnapshotRecorder(preludeSnapshot.get());
+  runScript(prelude, source->getBuffer());
+  prelude.setSnapshotRecorder(nullptr);
+  preludeSnapshot->write(preludeSnapshotFile, key, prelude.getIrGen());
+}
+
 int main(int argc, char** argv) {
+  cl::HideUnrelatedOptions(eaxCategory);
+  cl::ParseCommandLineOptions(argc, argv, "eax interpreter\n");
+  
   llvm::InitializeNativeTarget();
   llvm::InitializeNativeTargetAsmPrinter();
   llvm::InitializeNativeTargetAsmParser();
   
-  jit = llvm::make_unique<JIT>();
-  initModuleAndFnPassManager();
+  Timings::get().setEnabled(timingsFormat != NoTimings);
+  if (!pgoUseFile.empty() && !(pgoProfile = Profile::read(pgoUseFile))) return 1;
+  engine = llvm::make_unique<Engine>(getJITOptions(), getSessionOptions());
+  resultWriter = llvm::make_unique<ResultWriter>(std::cout, outputFormat);
   
-  mainInterpreterLoop();
+  if (printTargetInfo) engine->getJIT().printTargetInfo(llvm::errs());
+  if (!metricsFile.empty()) {
+    metricsFileWriter = llvm::make_unique<MetricsFileWriter>(
+      metricsFile, std::chrono::seconds(std::max(metricsInterval.getValue(), 1u)));
+  }
+  
+  if (!preludeFile.empty()) loadPrelude();
+  
+  if (!listenPath.empty()) {
+    runServer(*engine, listenPath);
+    if (!pgoGenerateFile.empty()) ProfileCounters::get().write(pgoGenerateFile);
+    metricsFileWriter.reset(); // Writes the final metrics.
+    // Connections may still be served on other threads, so the engine must
+    // not be destroyed.
+    std::quick_exit(0);
+  }
+  
+  replSession = engine->createSession();
+  if (!sampleFoldedFile.empty()) getSamplingProfiler().start(sampleFrequency);
+  
+  if (!scriptFile.empty() || batchMode) {
+    auto script = readFile(scriptFile.empty() ? "-" : scriptFile.getValue());
+    runScript(*replSession, script->getBuffer());
+  } else {
+    mainInterpreterLoop();
+  }
+  
+  replSession->linkCompiledDefinitions(true);
+  if (!sampleFoldedFile.empty()) {
+    samplingProfiler->stop();
+    std::ofstream file(sampleFoldedFile);
+    samplingProfiler->printFoldedStacks(file);
+    if (!file) error("couldn't write '", sampleFoldedFile, "'");
+  }
+  if (timingsFormat == TimingsTable) Timings::get().printTable(std::cerr);
+  else if (timingsFormat == TimingsJSON) Timings::get().printJSON(std::cerr);
+  if (!pgoGenerateFile.empty()) ProfileCounters::get().write(pgoGenerateFile);
+  metricsFileWriter.reset(); // Writes the final metrics.
 }
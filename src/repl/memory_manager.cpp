@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/Process.h>
+
+#include "memory_manager.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+static unsigned const readWrite = llvm::sys::Memory::MF_READ |
+                                  llvm::sys::Memory::MF_WRITE;
+
+static unsigned const finalProtection[NumSlabKinds] = {
+  llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_EXEC, // CodeSlab
+  llvm::sys::Memory::MF_READ, // ReadOnlySlab
+  readWrite, // ReadWriteSlab
+};
+
+static char* alignToPage(char* address) {
+  return reinterpret_cast<char*>(
+    llvm::alignTo(uintptr_t(address), llvm::sys::Process::getPageSize()));
+}
+
+static char* alignDownToPage(char* address) {
+  auto pageSize = llvm::sys::Process::getPageSize();
+  return reinterpret_cast<char*>(uintptr_t(address) / pageSize * pageSize);
+}
+
+SlabAllocator::SlabAllocator(size_t slabSize, size_t maxFreeSlabs)
+  : slabSize(llvm::alignTo(slabSize, llvm::sys::Process::getPageSize())),
+    maxFreeSlabs(maxFreeSlabs) {}
+
+SlabAllocator::~SlabAllocator() {
+  for (auto& slab : slabs) {
+    llvm::sys::Memory::releaseMappedMemory(slab->memory);
+  }
+  for (auto& memory : freeSlabs) {
+    llvm::sys::Memory::releaseMappedMemory(memory);
+  }
+}
+
+Slab* SlabAllocator::createSlab(SlabKind kind, size_t minSize) {
+  size_t size = std::max(slabSize,
+    size_t(llvm::alignTo(minSize, llvm::sys::Process::getPageSize())));
+  llvm::sys::MemoryBlock memory;
+  
+  if (size == slabSize && !freeSlabs.empty()) {
+    memory = freeSlabs.back();
+    freeSlabs.pop_back();
+  } else {
+    std::error_code ec;
+    memory = llvm::sys::Memory::allocateMappedMemory(size, nullptr,
+                                                     readWrite, ec);
+    if (ec) fatalError("failed to allocate JIT memory: ", ec.message());
+    mappedBytes += memory.size();
+  }
+  
+  auto base = static_cast<char*>(memory.base());
+  slabs.emplace_back(new Slab{kind, memory, base, base, 0});
+  return slabs.back().get();
+}
+
+void SlabAllocator::recycleSlab(Slab& slab) {
+  auto iterator = std::find_if(slabs.begin(), slabs.end(),
+    [&](std::unique_ptr<Slab> const& s) { return s.get() == &slab; });
+  assert(iterator != slabs.end());
+  
+  if (slab.memory.size() == slabSize && freeSlabs.size() < maxFreeSlabs) {
+    makeWritable(slab, slab.begin());
+    freeSlabs.push_back(slab.memory);
+  } else {
+    mappedBytes -= slab.memory.size();
+    llvm::sys::Memory::releaseMappedMemory(slab.memory);
+  }
+  
+  slabs.erase(iterator);
+}
+
+void SlabAllocator::makeWritable(Slab& slab, char* pageBegin) {
+  if (pageBegin >= slab.writableBegin) return;
+  
+  llvm::sys::MemoryBlock pages(pageBegin, slab.writableBegin - pageBegin);
+  llvm::sys::Memory::protectMappedMemory(pages, readWrite);
+  slab.writableBegin = pageBegin;
+}
+
+SlabAllocator::Allocation SlabAllocator::allocate(SlabKind kind, size_t size,
+                                                  unsigned alignment) {
+  if (!alignment) alignment = 16;
+  
+  Slab* slab = currentSlabs[kind];
+  char* address = nullptr;
+  
+  if (slab) {
+    // Code may be running on another thread, so a code page must stay
+    // executable once it's been finalized; new code starts on a fresh page.
+    char* next = kind == CodeSlab ? std::max(slab->next, slab->writableBegin)
+                                  : slab->next;
+    address = reinterpret_cast<char*>(llvm::alignAddr(next, alignment));
+  }
+  
+  if (!slab || address + size > slab->end()) {
+    slab = createSlab(kind, size + alignment);
+    address = reinterpret_cast<char*>(llvm::alignAddr(slab->next, alignment));
+    
+    // Keep packing into a regular slab; oversized ones only hold this section.
+    if (slab->memory.size() == slabSize) currentSlabs[kind] = slab;
+  }
+  
+  // The page may have been finalized together with an earlier module.
+  makeWritable(*slab, alignDownToPage(address));
+  
+  slab->next = address + size;
+  ++slab->liveAllocations;
+  usedBytes += size;
+  return {slab, address, size};
+}
+
+void SlabAllocator::release(Allocation const& allocation) {
+  Slab& slab = *allocation.slab;
+  usedBytes -= allocation.size;
+  if (--slab.liveAllocations > 0) return;
+  
+  if (currentSlabs[slab.kind] == &slab) {
+    // Start filling the current slab from the beginning again.
+    makeWritable(slab, slab.begin());
+    slab.next = slab.begin();
+  } else {
+    recycleSlab(slab);
+  }
+}
+
+bool SlabAllocator::finalize(Slab& slab, char* begin, char* end,
+                             std::string* errorMessage) {
+  if (slab.kind == ReadWriteSlab) return true;
+  
+  char* pageBegin = alignDownToPage(begin);
+  char* pageEnd = alignToPage(end);
+  llvm::sys::MemoryBlock pages(pageBegin, pageEnd - pageBegin);
+  
+  if (auto ec = llvm::sys::Memory::protectMappedMemory(pages,
+                                                       finalProtection[slab.kind])) {
+    if (errorMessage) *errorMessage = ec.message();
+    return false;
+  }
+  
+  slab.writableBegin = std::max(slab.writableBegin, pageEnd);
+  
+  if (slab.kind == CodeSlab) {
+    llvm::sys::Memory::InvalidateInstructionCache(begin, end - begin);
+  }
+  return true;
+}
+
+SlabMemoryManager::~SlabMemoryManager() {
+  for (auto const& allocation : allocations) {
+    allocator.release(allocation);
+  }
+}
+
+uint8_t* SlabMemoryManager::allocate(SlabKind kind, uintptr_t size,
+                                     unsigned alignment) {
+  allocations.push_back(allocator.allocate(kind, size, alignment));
+  return reinterpret_cast<uint8_t*>(allocations.back().address);
+}
+
+uint8_t* SlabMemoryManager::allocateCodeSection(uintptr_t size,
+                                                unsigned alignment,
+                                                unsigned sectionID,
+                                                llvm::StringRef sectionName) {
+  return allocate(CodeSlab, size, alignment);
+}
+
+uint8_t* SlabMemoryManager::allocateDataSection(uintptr_t size,
+                                                unsigned alignment,
+                                                unsigned sectionID,
+                                                llvm::StringRef sectionName,
+                                                bool isReadOnly) {
+  return allocate(isReadOnly ? ReadOnlySlab : ReadWriteSlab, size, alignment);
+}
+
+bool SlabMemoryManager::finalizeMemory(std::string* errorMessage) {
+  // Change the protection of each slab once, for the range covering all of
+  // this module's sections in it.
+  std::vector<std::pair<Slab*, std::pair<char*, char*>>> ranges;
+  
+  for (auto const& allocation : allocations) {
+    auto iterator = std::find_if(ranges.begin(), ranges.end(),
+      [&](std::pair<Slab*, std::pair<char*, char*>> const& range) {
+        return range.first == allocation.slab;
+      });
+    char* end = allocation.address + allocation.size;
+    
+    if (iterator == ranges.end()) {
+      ranges.push_back({allocation.slab, {allocation.address, end}});
+    } else {
+      iterator->second.first = std::min(iterator->second.first, allocation.address);
+      iterator->second.second = std::max(iterator->second.second, end);
+    }
+  }
+  
+  for (auto const& range : ranges) {
+    if (!allocator.finalize(*range.first, range.second.first,
+                            range.second.second, errorMessage)) {
+      return true;
+    }
+  }
+  return false;
+}
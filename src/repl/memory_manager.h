@@ -0,0 +1,111 @@
+#ifndef EAX_MEMORY_MANAGER_H
+#define EAX_MEMORY_MANAGER_H
+
+#include <memory>
+#include <vector>
+#include <llvm/ExecutionEngine/RTDyldMemoryManager.h>
+#include <llvm/Support/Memory.h>
+
+namespace eax {
+
+enum SlabKind {
+  CodeSlab,
+  ReadOnlySlab,
+  ReadWriteSlab,
+  NumSlabKinds
+};
+
+/// A large mapping that the sections of many modules are packed into.
+struct Slab {
+  SlabKind kind;
+  llvm::sys::MemoryBlock memory;
+  char* next; // Where the next allocation starts.
+  char* writableBegin; // Pages before this have been finalized.
+  size_t liveAllocations;
+  
+  char* begin() const { return static_cast<char*>(memory.base()); }
+  char* end() const { return begin() + memory.size(); }
+};
+
+/// Packs the sections of JIT-compiled modules into shared slabs, one set
+/// for each kind of memory protection. A slab whose allocations have all
+/// been released is recycled for later modules.
+///
+/// Permissions are changed once per module and slab, for the page range
+/// covering all of the module's sections. This assumes that each module is
+/// finalized before the next one is loaded, which the JIT guarantees. Data
+/// pages may be shared between modules, but code pages are never made
+/// writable again while they hold live code.
+class SlabAllocator {
+public:
+  struct Allocation {
+    Slab* slab;
+    char* address;
+    size_t size;
+  };
+  
+public:
+  SlabAllocator(size_t slabSize = 1 << 20, size_t maxFreeSlabs = 8);
+  SlabAllocator(SlabAllocator const&) = delete;
+  SlabAllocator& operator=(SlabAllocator const&) = delete;
+  ~SlabAllocator();
+  
+  /// Returns writable memory of the given size and alignment from a slab
+  /// of the given kind.
+  Allocation allocate(SlabKind, size_t size, unsigned alignment);
+  
+  /// Releases memory obtained from allocate().
+  void release(Allocation const&);
+  
+  /// Applies the final protection of the slab's kind to the pages
+  /// covering [begin, end).
+  bool finalize(Slab&, char* begin, char* end, std::string* errorMessage);
+  
+  /// Returns the number of bytes currently mapped, whether in use or not.
+  size_t getMappedBytes() const { return mappedBytes; }
+  
+  /// Returns the number of bytes currently allocated to live modules.
+  size_t getUsedBytes() const { return usedBytes; }
+  
+private:
+  Slab* createSlab(SlabKind, size_t minSize);
+  void recycleSlab(Slab&);
+  void makeWritable(Slab&, char* pageBegin);
+  
+private:
+  size_t const slabSize;
+  size_t const maxFreeSlabs;
+  size_t mappedBytes = 0;
+  size_t usedBytes = 0;
+  Slab* currentSlabs[NumSlabKinds] = {};
+  std::vector<std::unique_ptr<Slab>> slabs;
+  std::vector<llvm::sys::MemoryBlock> freeSlabs;
+};
+
+/// A memory manager for the sections of a single JIT-compiled module.
+/// Works like llvm::SectionMemoryManager, but takes its memory from a
+/// shared SlabAllocator and gives it back when the module is removed.
+class SlabMemoryManager : public llvm::RTDyldMemoryManager {
+public:
+  SlabMemoryManager(SlabAllocator& allocator) : allocator(allocator) {}
+  ~SlabMemoryManager() override;
+  
+  uint8_t* allocateCodeSection(uintptr_t size, unsigned alignment,
+                               unsigned sectionID,
+                               llvm::StringRef sectionName) override;
+  uint8_t* allocateDataSection(uintptr_t size, unsigned alignment,
+                               unsigned sectionID, llvm::StringRef sectionName,
+                               bool isReadOnly) override;
+  bool finalizeMemory(std::string* errorMessage = nullptr) override;
+  
+private:
+  uint8_t* allocate(SlabKind, uintptr_t size, unsigned alignment);
+  
+private:
+  SlabAllocator& allocator;
+  std::vector<SlabAllocator::Allocation> allocations;
+};
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include "perf_map.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+PerfMap::PerfMap() {
+  std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+  file = std::fopen(path.c_str(), "w");
+  if (!file) error("couldn't write '", path, "': ", std::strerror(errno));
+}
+
+PerfMap::~PerfMap() {
+  if (file) std::fclose(file);
+}
+
+void PerfMap::add(uint64_t address, uint64_t size, llvm::StringRef name) {
+  if (!file) return;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::fprintf(file, "%" PRIx64 " %" PRIx64 " %.*s\n", address, size,
+               int(name.size()), name.data());
+  // Flush each entry, so that the map is complete whenever the profiler
+  // reads it, even if the process is killed.
+  std::fflush(file);
+}
@@ -0,0 +1,30 @@
+#ifndef EAX_PERF_MAP_H
+#define EAX_PERF_MAP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <llvm/ADT/StringRef.h>
+
+namespace eax {
+
+/// Writes the address ranges of JIT-compiled functions to
+/// /tmp/perf-<pid>.map, where perf and other Linux profilers look for the
+/// symbols of code that isn't backed by a file.
+class PerfMap {
+public:
+  PerfMap();
+  PerfMap(PerfMap const&) = delete;
+  PerfMap& operator=(PerfMap const&) = delete;
+  ~PerfMap();
+  
+  void add(uint64_t address, uint64_t size, llvm::StringRef name);
+  
+private:
+  std::mutex mutex;
+  FILE* file;
+};
+
+}
+
+#endif
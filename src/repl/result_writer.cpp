@@ -0,0 +1,76 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "result_writer.h"
+
+using namespace eax;
+
+void eax::appendDouble(std::string& out, double value) {
+  // Integers, the most common results, are formatted without snprintf.
+  if (std::abs(value) < 1e15 && value == std::trunc(value)) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* begin = end;
+    auto magnitude = static_cast<unsigned long long>(std::abs(value));
+    do {
+      *--begin = char('0' + magnitude % 10);
+      magnitude /= 10;
+    } while (magnitude != 0);
+    if (std::signbit(value)) *--begin = '-';
+    out.append(begin, end);
+    return;
+  }
+  
+  // 17 significant digits always suffice; try fewer first, since trailing
+  // zeros are stripped.
+  char digits[32];
+  for (int precision = 15;; ++precision) {
+    int length = std::snprintf(digits, sizeof(digits), "%.*g", precision, value);
+    if (precision == 17 || std::strtod(digits, nullptr) == value) {
+      out.append(digits, length);
+      return;
+    }
+  }
+}
+
+static void appendElement(std::string& out, EvalResult::Element element) {
+  if (element.isBool) out += element.value != 0 ? "true" : "false";
+  else appendDouble(out, element.value);
+}
+
+void eax::appendResult(std::string& out, EvalResult const& result, ResultFormat format) {
+  switch (format) {
+  case ResultFormat::Text:
+    if (result.isTuple) out += '(';
+    for (size_t i = 0; i < result.elements.size(); ++i) {
+      if (i > 0) out += ", ";
+      appendElement(out, result.elements[i]);
+    }
+    if (result.isTuple) out += ')';
+    out += '\n';
+    break;
+  case ResultFormat::CSV:
+    for (size_t i = 0; i < result.elements.size(); ++i) {
+      if (i > 0) out += ',';
+      appendElement(out, result.elements[i]);
+    }
+    out += '\n';
+    break;
+  case ResultFormat::Binary:
+    for (auto element : result.elements) {
+      out.append(reinterpret_cast<char const*>(&element.value), sizeof(double));
+    }
+    break;
+  }
+}
+
+void ResultWriter::writeBuffer() {
+  out.write(buffer.data(), buffer.size());
+  buffer.clear();
+}
+
+void ResultWriter::flush() {
+  writeBuffer();
+  out.flush();
+}
@@ -0,0 +1,66 @@
+#ifndef EAX_RESULT_WRITER_H
+#define EAX_RESULT_WRITER_H
+
+#include <ostream>
+#include <string>
+#include <llvm/ADT/SmallVector.h>
+
+namespace eax {
+
+/// The value of a top-level expression: a Number, a Bool, or a tuple of them.
+struct EvalResult {
+  struct Element {
+    double value; // Bools are 0 or 1.
+    bool isBool;
+  };
+  llvm::SmallVector<Element, 4> elements;
+  bool isTuple = false;
+};
+
+enum class ResultFormat {
+  Text,   // One result per line, e.g. "1.5", "true" or "(1, 2)".
+  CSV,    // One result per line, with the elements of tuples as columns.
+  Binary, // Each element as a double in native byte order, Bools as 0 or 1.
+};
+
+/// Appends "result" to "out" in the given format, including the line break
+/// of the text formats.
+void appendResult(std::string& out, EvalResult const& result, ResultFormat format);
+
+/// Appends the shortest decimal representation of "value" that reads back as
+/// the same double, e.g. "0.1" or "3" rather than "0.100000" or "3.000000".
+void appendDouble(std::string& out, double value);
+
+/// Writes the results of top-level expressions to a stream. The results are
+/// buffered, and only written when the buffer is full or on flush(), since
+/// writing and flushing the stream per result dominates the run time of
+/// scripts that evaluate many cheap expressions.
+class ResultWriter {
+public:
+  ResultWriter(std::ostream& out, ResultFormat format) : out(out), format(format) {}
+  ResultWriter(ResultWriter const&) = delete;
+  ResultWriter& operator=(ResultWriter const&) = delete;
+  ~ResultWriter() { flush(); }
+  
+  void write(EvalResult const& result) {
+    appendResult(buffer, result, format);
+    if (buffer.size() >= bufferSize) writeBuffer();
+  }
+  
+  /// Writes the buffered results and flushes the stream, e.g. before other
+  /// output or at the end of a batch.
+  void flush();
+  
+private:
+  void writeBuffer();
+  
+private:
+  static size_t const bufferSize = 64 * 1024;
+  std::ostream& out;
+  ResultFormat const format;
+  std::string buffer;
+};
+
+}
+
+#endif
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <set>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define EAX_SAMPLING_SUPPORTED 1
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+#include "sampling_profiler.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+static size_t const maxStackDepth = 64;
+
+namespace eax {
+
+/// A bounded queue of samples that signal handlers on any thread can write
+/// without locking (Vyukov's bounded MPMC queue). Samples that don't fit are
+/// dropped.
+class SampleBuffer {
+public:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    uint32_t depth;
+    uint64_t frames[maxStackDepth]; // Innermost first.
+  };
+  
+  static size_t const capacity = 4096;
+  
+  SampleBuffer() {
+    for (size_t i = 0; i < capacity; ++i) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  
+  /// Claims a slot for writing, or returns null if the buffer is full.
+  Slot* beginWrite(size_t& position) {
+    position = writePosition.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots[position % capacity];
+      size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence == position) {
+        if (writePosition.compare_exchange_weak(position, position + 1,
+                                                std::memory_order_relaxed)) {
+          return &slot;
+        }
+      } else if (sequence < position) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      } else {
+        position = writePosition.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  
+  void endWrite(Slot& slot, size_t position) {
+    slot.sequence.store(position + 1, std::memory_order_release);
+  }
+  
+  /// Passes each complete sample to "process", oldest first. Must not be
+  /// called concurrently with itself.
+  template<typename F>
+  void read(F process) {
+    while (true) {
+      Slot& slot = slots[readPosition % capacity];
+      if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1) break;
+      process(llvm::makeArrayRef(slot.frames, slot.depth));
+      slot.sequence.store(readPosition + capacity, std::memory_order_release);
+      ++readPosition;
+    }
+  }
+  
+  uint64_t takeDropped() { return dropped.exchange(0); }
+  
+private:
+  Slot slots[capacity];
+  std::atomic<size_t> writePosition{0};
+  size_t readPosition = 0;
+  std::atomic<uint64_t> dropped{0};
+};
+
+}
+
+#ifdef EAX_SAMPLING_SUPPORTED
+
+static std::atomic<SampleBuffer*> activeBuffer{nullptr};
+static pid_t processID;
+static struct sigaction previousAction;
+
+/// Copies memory that may not be mapped, e.g. a frame pointer that wasn't
+/// one, without faulting.
+static bool readMemory(uint64_t address, void* destination, size_t size) {
+  iovec local = {destination, size};
+  iovec remote = {reinterpret_cast<void*>(address), size};
+  return process_vm_readv(processID, &local, 1, &remote, 1, 0) == ssize_t(size);
+}
+
+static void recordSample(int, siginfo_t*, void* context) {
+  SampleBuffer* buffer = activeBuffer.load(std::memory_order_acquire);
+  if (!buffer) return;
+  int savedErrno = errno;
+  
+  auto& machineContext = static_cast<ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+  uint64_t pc = machineContext.gregs[REG_RIP];
+  uint64_t fp = machineContext.gregs[REG_RBP];
+#else
+  uint64_t pc = machineContext.pc;
+  uint64_t fp = machineContext.regs[29];
+#endif
+
+  size_t position;
+  if (auto slot = buffer->beginWrite(position)) {
+    slot->frames[0] = pc;
+    slot->depth = 1;
+    // Each frame starts with the caller's frame pointer, followed by the
+    // return address. Frames get older towards higher addresses.
+    while (slot->depth < maxStackDepth && fp % sizeof(uint64_t) == 0) {
+      uint64_t frame[2];
+      if (!readMemory(fp, frame, sizeof(frame)) || frame[1] == 0) break;
+      // Look up the call instruction rather than the one after it, which may
+      // belong to another function.
+      slot->frames[slot->depth++] = frame[1] - 1;
+      if (frame[0] <= fp) break;
+      fp = frame[0];
+    }
+    buffer->endWrite(*slot, position);
+  }
+  
+  errno = savedErrno;
+}
+
+#endif
+
+SamplingProfiler::SamplingProfiler(CodeMap const& codeMap)
+  : codeMap(codeMap), buffer(llvm::make_unique<SampleBuffer>()) {}
+
+SamplingProfiler::~SamplingProfiler() {
+  stop();
+}
+
+bool SamplingProfiler::start(unsigned frequency) {
+#ifdef EAX_SAMPLING_SUPPORTED
+  if (running) return true;
+  if (frequency == 0 || frequency > 100000) {
+    error("sampling frequency must be between 1 and 100000 per second");
+    return false;
+  }
+  
+  SampleBuffer* expected = nullptr;
+  if (!activeBuffer.compare_exchange_strong(expected, buffer.get())) {
+    error("another sampling profiler is already running");
+    return false;
+  }
+  processID = getpid();
+  
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_sigaction = recordSample;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, &previousAction);
+  
+  itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = std::max(1000000 / frequency, 1u);
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    error("couldn't start the sampling timer: ", std::strerror(errno));
+    sigaction(SIGPROF, &previousAction, nullptr);
+    activeBuffer = nullptr;
+    return false;
+  }
+  
+  running = true;
+  processingThread = std::thread([this] {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running) {
+      stopRequested.wait_for(lock, std::chrono::milliseconds(100));
+      lock.unlock();
+      processSamples();
+      lock.lock();
+    }
+  });
+  return true;
+#else
+  (void) frequency;
+  error("sampling is not supported on this platform");
+  return false;
+#endif
+}
+
+void SamplingProfiler::stop() {
+#ifdef EAX_SAMPLING_SUPPORTED
+  if (!running) return;
+  
+  itimerval timer;
+  std::memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  sigaction(SIGPROF, &previousAction, nullptr);
+  // A handler may still be running; the buffer lives as long as the
+  // profiler, so it's safe for it to finish.
+  activeBuffer = nullptr;
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  stopRequested.notify_one();
+  processingThread.join();
+  processSamples();
+#endif
+}
+
+void SamplingProfiler::processSamples() {
+  std::lock_guard<std::mutex> lock(mutex);
+  droppedSamples += buffer->takeDropped();
+  
+  buffer->read([&](llvm::ArrayRef<uint64_t> frames) {
+    // Keep the innermost run of eax frames. Native code above it, e.g. a
+    // math library function, is summarized as a single frame.
+    std::vector<std::string> names;
+    bool inNativeCode = false;
+    for (uint64_t address : frames) {
+      std::string name = codeMap.lookup(address);
+      if (name.empty()) {
+        if (!names.empty()) break;
+        inNativeCode = true;
+      } else {
+        names.push_back(std::move(name));
+      }
+    }
+    
+    if (names.empty()) {
+      ++otherSamples;
+      return;
+    }
+    
+    std::string stack;
+    for (auto const& name : llvm::make_range(names.rbegin(), names.rend())) {
+      if (!stack.empty()) stack += ';';
+      stack += name;
+    }
+    if (inNativeCode) stack += ";[native]";
+    ++stacks[stack];
+  });
+}
+
+void SamplingProfiler::reset() {
+  processSamples();
+  std::lock_guard<std::mutex> lock(mutex);
+  stacks.clear();
+  otherSamples = 0;
+  droppedSamples = 0;
+}
+
+/// Calls "f" with the frames of each folded stack, outermost first, and its
+/// number of samples.
+template<typename F>
+static void forEachStack(std::map<std::string, uint64_t> const& stacks, F f) {
+  llvm::SmallVector<llvm::StringRef, 16> frames;
+  for (auto const& stack : stacks) {
+    frames.clear();
+    llvm::StringRef(stack.first).split(frames, ';');
+    f(frames, stack.second);
+  }
+}
+
+void SamplingProfiler::printFlatProfile(std::ostream& out) {
+  processSamples();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  struct Counts { uint64_t self = 0, total = 0; };
+  std::map<std::string, Counts> functions;
+  uint64_t numSamples = 0;
+  
+  forEachStack(stacks, [&](llvm::ArrayRef<llvm::StringRef> frames,
+                           uint64_t count) {
+    numSamples += count;
+    functions[frames.back().str()].self += count;
+    // Count recursive functions once per stack.
+    std::set<llvm::StringRef> seen(frames.begin(), frames.end());
+    for (auto name : seen) functions[name.str()].total += count;
+  });
+  
+  std::vector<std::pair<std::string, Counts>> sorted(functions.begin(),
+                                                     functions.end());
+  std::sort(sorted.begin(), sorted.end(), [](std::pair<std::string, Counts> const& a,
+                                             std::pair<std::string, Counts> const& b) {
+    return a.second.self != b.second.self ? a.second.self > b.second.self
+                                          : a.second.total > b.second.total;
+  });
+  
+  size_t nameWidth = 8;
+  for (auto const& function : sorted) {
+    nameWidth = std::max(nameWidth, function.first.size());
+  }
+  
+  auto flags = out.flags();
+  auto percentage = [&](uint64_t count) {
+    return numSamples ? 100.0 * count / numSamples : 0;
+  };
+  out << std::left << std::setw(nameWidth) << "function" << std::right
+      << std::setw(10) << "self" << std::setw(8) << "self %"
+      << std::setw(10) << "total" << std::setw(9) << "total %" << '\n';
+  for (auto const& function : sorted) {
+    out << std::left << std::setw(nameWidth) << function.first << std::right
+        << std::fixed << std::setprecision(1)
+        << std::setw(10) << function.second.self
+        << std::setw(8) << percentage(function.second.self)
+        << std::setw(10) << function.second.total
+        << std::setw(9) << percentage(function.second.total) << '\n';
+  }
+  out << numSamples << " samples in eax code, " << otherSamples << " elsewhere";
+  if (droppedSamples) out << ", " << droppedSamples << " dropped";
+  out << std::endl;
+  out.flags(flags);
+}
+
+void SamplingProfiler::printCallGraph(std::ostream& out) {
+  processSamples();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  struct Node {
+    uint64_t total = 0;
+    std::map<std::string, uint64_t> callers;
+    std::map<std::string, uint64_t> callees;
+  };
+  std::map<std::string, Node> nodes;
+  
+  forEachStack(stacks, [&](llvm::ArrayRef<llvm::StringRef> frames,
+                           uint64_t count) {
+    std::set<llvm::StringRef> seen(frames.begin(), frames.end());
+    for (auto name : seen) nodes[name.str()].total += count;
+    
+    std::set<std::pair<llvm::StringRef, llvm::StringRef>> calls;
+    for (size_t i = 1; i < frames.size(); ++i) {
+      calls.emplace(frames[i - 1], frames[i]);
+    }
+    for (auto const& call : calls) {
+      nodes[call.first.str()].callees[call.second.str()] += count;
+      nodes[call.second.str()].callers[call.first.str()] += count;
+    }
+  });
+  
+  std::vector<std::pair<std::string, Node const*>> sorted;
+  for (auto const& node : nodes) sorted.emplace_back(node.first, &node.second);
+  std::sort(sorted.begin(), sorted.end(),
+            [](std::pair<std::string, Node const*> const& a,
+               std::pair<std::string, Node const*> const& b) {
+              return a.second->total > b.second->total;
+            });
+  
+  for (auto const& node : sorted) {
+    out << node.first << " (" << node.second->total << ")\n";
+    for (auto const& caller : node.second->callers) {
+      out << "  <- " << caller.first << " (" << caller.second << ")\n";
+    }
+    for (auto const& callee : node.second->callees) {
+      out << "  -> " << callee.first << " (" << callee.second << ")\n";
+    }
+  }
+  out.flush();
+}
+
+void SamplingProfiler::printFoldedStacks(std::ostream& out) {
+  processSamples();
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto const& stack : stacks) {
+    out << stack.first << ' ' << stack.second << '\n';
+  }
+  out.flush();
+}
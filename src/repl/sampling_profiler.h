@@ -0,0 +1,82 @@
+#ifndef EAX_SAMPLING_PROFILER_H
+#define EAX_SAMPLING_PROFILER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#include "code_map.h"
+
+namespace eax {
+
+class SampleBuffer;
+
+/// A statistical profiler for JIT-compiled code. While it runs, SIGPROF
+/// interrupts whichever thread is using the CPU at a fixed rate, and the
+/// signal handler records the program counter and the return addresses
+/// found by following the frame pointers. A background thread maps the
+/// samples to eax functions using the JIT's CodeMap. Only the frames in
+/// JIT-compiled code are kept; time spent in native functions called from
+/// eax code is attributed to "[native]", and samples without any eax frame
+/// are only counted.
+///
+/// Call stacks are only complete if the code was generated with frame
+/// pointers (see IrGen::setKeepFramePointers()). Only one profiler can run
+/// at a time. Sampling is supported on Linux on x86-64 and AArch64.
+class SamplingProfiler {
+public:
+  SamplingProfiler(CodeMap const& codeMap);
+  SamplingProfiler(SamplingProfiler const&) = delete;
+  SamplingProfiler& operator=(SamplingProfiler const&) = delete;
+  ~SamplingProfiler();
+  
+  /// Starts sampling at the given rate, in samples per second of CPU time.
+  /// Reports an error and returns false if sampling isn't possible.
+  bool start(unsigned frequency);
+  
+  /// Stops sampling, and processes the remaining samples.
+  void stop();
+  bool isRunning() const { return running; }
+  
+  /// Forgets the samples collected so far.
+  void reset();
+  
+  /// Prints the samples of each function: those where it was running
+  /// ("self") and those where it was on the stack ("total").
+  void printFlatProfile(std::ostream& out);
+  
+  /// Prints the callers and callees of each function, with the number of
+  /// samples in which each call was on the stack.
+  void printCallGraph(std::ostream& out);
+  
+  /// Prints one line per distinct stack, from the outermost function to the
+  /// innermost, separated by semicolons, followed by its number of samples.
+  /// This is the input format of flame graph tools.
+  void printFoldedStacks(std::ostream& out);
+  
+private:
+  /// Maps the samples recorded since the last call to eax functions.
+  void processSamples();
+  
+private:
+  CodeMap const& codeMap;
+  std::unique_ptr<SampleBuffer> buffer;
+  bool running = false;
+  std::thread processingThread;
+  std::condition_variable stopRequested;
+  
+  /// Guards the members below, and the reading end of "buffer".
+  std::mutex mutex;
+  std::map<std::string, uint64_t> stacks; // Folded stack -> number of samples.
+  uint64_t otherSamples = 0; // Samples without eax frames.
+  uint64_t droppedSamples = 0; // Samples lost because the buffer was full.
+};
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <llvm/ADT/StringRef.h>
+
+#include "server.h"
+#include "engine.h"
+#include "result_writer.h"
+#include "../parser/script_parser.h"
+#include "../util/error.h"
+
+using namespace eax;
+
+static size_t const frameHeaderSize = 4;
+static size_t const maxFrameSize = 64 << 20;
+
+/// How long the accept loop waits at most before checking whether to stop.
+/// The signal may be handled by another thread, which doesn't interrupt
+/// the wait.
+static int const stopPollMilliseconds = 200;
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+  stopRequested = 1;
+}
+
+static uint32_t readFrameSize(char const* header) {
+  auto bytes = reinterpret_cast<unsigned char const*>(header);
+  return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 |
+         uint32_t(bytes[2]) << 8 | uint32_t(bytes[3]);
+}
+
+static void appendFrameSize(std::string& out, uint32_t size) {
+  out += char(size >> 24);
+  out += char(size >> 16);
+  out += char(size >> 8);
+  out += char(size);
+}
+
+/// Appends each line of "text" to "response", after "prefix".
+static void appendLines(std::string& response, char prefix, llvm::StringRef text) {
+  while (!text.empty()) {
+    auto split = text.split('\n');
+    response += prefix;
+    response += split.first;
+    response += '\n';
+    text = split.second;
+  }
+}
+
+static std::string handleRequest(Session& session, llvm::StringRef request) {
+  std::string response;
+  std::ostringstream diagnostics;
+  std::ostream* previousStream = diagnosticStream();
+  diagnosticStream() = &diagnostics;
+  
+  for (auto& item : parseScript(request, 1)) {
+    appendLines(response, '!', item.diagnostics);
+    
+    switch (item.kind) {
+    case ScriptItem::Definition:
+      session.define(std::move(item.fn));
+      break;
+    case ScriptItem::Expression: {
+      EvalResult result;
+      if (session.evaluate(*item.fn, result)) {
+        response += '=';
+        appendResult(response, result, ResultFormat::Text);
+      }
+      break;
+    }
+    case ScriptItem::Command:
+      error("commands are not supported by the server");
+      break;
+    case ScriptItem::Invalid:
+      break;
+    }
+    
+    appendLines(response, '!', diagnostics.str());
+    diagnostics.str("");
+  }
+  
+  diagnosticStream() = previousStream;
+  return response;
+}
+
+static bool writeAll(int fd, std::string const& data) {
+  for (size_t written = 0; written < data.size();) {
+    ssize_t result = ::write(fd, data.data() + written, data.size() - written);
+    if (result < 0 && errno == EINTR) continue;
+    if (result <= 0) return false;
+    written += result;
+  }
+  return true;
+}
+
+static void serveConnection(Engine& engine, int fd) {
+  auto session = engine.createSession();
+  std::string input;
+  std::string output;
+  char buffer[64 * 1024];
+  
+  while (true) {
+    ssize_t received = ::read(fd, buffer, sizeof(buffer));
+    if (received < 0 && errno == EINTR) continue;
+    if (received <= 0) break;
+    input.append(buffer, received);
+    
+    // Handle all complete requests that have arrived, and send their
+    // responses together, so that pipelined requests cost one write.
+    size_t position = 0;
+    while (input.size() - position >= frameHeaderSize) {
+      uint32_t size = readFrameSize(&input[position]);
+      if (size > maxFrameSize) {
+        error("closing a connection: request of ", size, " bytes is too large");
+        ::close(fd);
+        return;
+      }
+      if (input.size() - position - frameHeaderSize < size) break;
+      
+      llvm::StringRef request(&input[position + frameHeaderSize], size);
+      std::string response = handleRequest(*session, request);
+      appendFrameSize(output, uint32_t(response.size()));
+      output += response;
+      position += frameHeaderSize + size;
+    }
+    input.erase(0, position);
+    
+    if (!output.empty()) {
+      if (!writeAll(fd, output)) break;
+      output.clear();
+    }
+  }
+  
+  ::close(fd);
+}
+
+void eax::runServer(Engine& engine, std::string const& socketPath) {
+  // Don't let a client that goes away kill the server, and stop cleanly on
+  // SIGINT and SIGTERM, so that the caller can write its reports.
+  std::signal(SIGPIPE, SIG_IGN);
+  stopRequested = 0;
+  std::signal(SIGINT, requestStop);
+  std::signal(SIGTERM, requestStop);
+  
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    fatalError("socket path '", socketPath, "' is too long");
+  }
+  std::strcpy(address.sun_path, socketPath.c_str());
+  
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) fatalError("couldn't create a socket: ", std::strerror(errno));
+  
+  ::unlink(socketPath.c_str());
+  if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+      ::listen(listener, SOMAXCONN) < 0) {
+    fatalError("couldn't listen on '", socketPath, "': ", std::strerror(errno));
+  }
+  
+  while (!stopRequested) {
+    pollfd pollFd = {listener, POLLIN, 0};
+    int ready = ::poll(&pollFd, 1, stopPollMilliseconds);
+    if (ready <= 0) {
+      if (ready < 0 && errno != EINTR) {
+        error("couldn't wait for connections: ", std::strerror(errno));
+      }
+      continue;
+    }
+    
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno != EINTR) error("couldn't accept a connection: ", std::strerror(errno));
+      continue;
+    }
+    std::thread(serveConnection, std::ref(engine), fd).detach();
+  }
+  
+  // Connections that are still open are served until the process exits.
+  ::close(listener);
+  ::unlink(socketPath.c_str());
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+}
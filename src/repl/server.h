@@ -0,0 +1,27 @@
+#ifndef EAX_SERVER_H
+#define EAX_SERVER_H
+
+#include <string>
+
+namespace eax {
+
+class Engine;
+
+/// Serves evaluation requests on a Unix domain socket at "socketPath" until
+/// the process receives SIGINT or SIGTERM, then removes the socket and
+/// returns. Each connection is served on a thread of its own, with a session
+/// of its own.
+///
+/// Requests and responses are framed: a frame is a 4-byte length in network
+/// byte order, followed by that many bytes. A request holds any number of
+/// definitions and expressions, like a script. Its response has a line for
+/// each result and diagnostic, in order: "=" followed by the value of an
+/// expression in the text format of ResultWriter, or "!" followed by a
+/// diagnostic message. Clients can pipeline
+/// requests, i.e. send more of them without waiting for the responses, which
+/// are sent back in order.
+void runServer(Engine& engine, std::string const& socketPath);
+
+}
+
+#endif
@@ -0,0 +1,421 @@
+#include <chrono>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "session.h"
+#include "../ast/ast_hasher.h"
+#include "../ir_gen/optimizer.h"
+#include "../util/error.h"
+#include "../util/metrics.h"
+
+using namespace eax;
+
+namespace {
+
+/// The metrics of all sessions together.
+struct SessionMetrics {
+  Metrics& metrics = Metrics::get();
+  Gauge& sessions = metrics.getGauge(
+    "eax_sessions", "Number of live sessions");
+  Gauge& definitions = metrics.getGauge(
+    "eax_definitions", "Number of function definitions in live sessions");
+  Gauge& prototypes = metrics.getGauge(
+    "eax_irgen_prototypes", "Number of function prototypes held by the IR "
+    "generators of live sessions");
+  Counter& evaluations = metrics.getCounter(
+    "eax_evaluations_total", "Number of evaluated top-level expressions");
+  Counter& exprCacheHits = metrics.getCounter(
+    "eax_expr_cache_hits_total", "Number of top-level expressions found compiled "
+    "in the cache");
+  Counter& definitionsReused = metrics.getCounter(
+    "eax_definitions_reused_total", "Number of definitions of scripts that "
+    "weren't recompiled because they were identical to the current ones");
+  Histogram& evaluateLatency = metrics.getHistogram(
+    "eax_evaluate_seconds", "Time to evaluate a top-level expression, "
+    "including compiling it if it isn't cached");
+  Histogram& exprCompileLatency = metrics.getHistogram(
+    "eax_expr_compile_seconds", "Time to compile and link a top-level expression "
+    "that isn't cached");
+};
+
+}
+
+static SessionMetrics& getMetrics() {
+  static SessionMetrics metrics;
+  return metrics;
+}
+
+/// Returns a hash of a definition's name, parameters and body. Formatting
+/// and comments don't affect it.
+static size_t hashDefinition(Function& fn) {
+  AstHasher hasher;
+  fn.accept(hasher);
+  return hasher.getHash();
+}
+
+/// Returns whether two definitions of the same name are identical, apart
+/// from whitespace and comments.
+static bool isSameDefinition(Function& a, Function& b) {
+  return a.getPrototype()->getParamNames() == b.getPrototype()->getParamNames() &&
+         ExprCache::getCanonicalForm(a.getBody()) ==
+           ExprCache::getCanonicalForm(b.getBody());
+}
+
+Session::Session(JIT& jit, std::string scope, SessionOptions const& options,
+                 Session const* prelude)
+  : jit(jit),
+    scope(std::move(scope)),
+    options(options),
+    targetMachine(jit.createTargetMachine()),
+    irgen(llvmContext),
+    exprCache(jit, options.exprCacheSize),
+    backgroundCompiler(jit) {
+  if (prelude) irgen.importSignatures(prelude->getIrGen());
+  irgen.setFastMathFlags(options.fastMathFlags);
+  irgen.setProfileCalls(options.profileCalls);
+  irgen.setKeepFramePointers(options.keepFramePointers);
+  irgen.setPGOInstrument(options.pgoInstrument);
+  irgen.setPGOProfile(options.pgoProfile);
+  initModuleAndFnPassManager();
+  getMetrics().sessions.add(1);
+  updateSizeMetrics();
+}
+
+Session::~Session() {
+  // Wait for the background compiler, so that nothing is linked into the
+  // scope after it has been removed.
+  for (auto& compiling : compilingDefinitions) {
+    compiling.result.wait();
+  }
+  if (!scope.empty()) jit.removeScope(scope);
+  
+  getMetrics().sessions.add(-1);
+  getMetrics().definitions.add(-double(reportedDefinitions));
+  getMetrics().prototypes.add(-double(reportedPrototypes));
+}
+
+/// Updates the metrics of the sizes of the session's data structures,
+/// which are summed over all sessions.
+void Session::updateSizeMetrics() {
+  getMetrics().definitions.add(double(definitions.size()) - double(reportedDefinitions));
+  getMetrics().prototypes.add(double(irgen.getNumPrototypes()) - double(reportedPrototypes));
+  reportedDefinitions = definitions.size();
+  reportedPrototypes = irgen.getNumPrototypes();
+}
+
+void Session::initModuleAndFnPassManager() {
+  globalModule = llvm::make_unique<llvm::Module>("eaxjit", llvmContext);
+  globalModule->setDataLayout(targetMachine->createDataLayout());
+  
+  fnPassManager = createFnPassManager(*globalModule, *targetMachine);
+  
+  irgen.setModule(*globalModule);
+  irgen.setFnPassManager(fnPassManager.get());
+}
+
+bool Session::evaluate(llvm::orc::TargetAddress addr, llvm::Type* type,
+                       EvalResult& result) {
+  result.elements.clear();
+  result.isTuple = false;
+  if (type == llvm::Type::getInt1Ty(llvmContext)) {
+    result.elements.push_back({double(reinterpret_cast<bool(*)()>(addr)()), true});
+    return true;
+  }
+  if (type == llvm::Type::getDoubleTy(llvmContext)) {
+    result.elements.push_back({reinterpret_cast<double(*)()>(addr)(), false});
+    return true;
+  }
+  if (auto tupleType = llvm::dyn_cast<llvm::StructType>(type)) {
+    llvm::SmallVector<double, 4> elements(tupleType->getNumElements());
+    reinterpret_cast<void(*)(double*)>(addr)(elements.data());
+    
+    result.isTuple = true;
+    for (unsigned i = 0; i < elements.size(); ++i) {
+      result.elements.push_back({elements[i], tupleType->getElementType(i)->isIntegerTy(1)});
+    }
+    return true;
+  }
+  std::string typeName;
+  llvm::raw_string_ostream stream(typeName);
+  type->print(stream);
+  error("can't evaluate an expression of type '", stream.str(), "'");
+  return false;
+}
+
+void Session::linkCompiledDefinitions(bool wait) {
+  linkDefinitions(wait ? compilingDefinitions.size() : 0);
+}
+
+/// Links the definitions compiled in the background into the JIT, waiting
+/// for the first "count" of them. The rest are linked only if they're done.
+void Session::linkDefinitions(size_t count) {
+  while (!compilingDefinitions.empty()) {
+    auto& result = compilingDefinitions.front().result;
+    if (count > 0) {
+      --count;
+    } else if (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      break;
+    }
+    
+    CompiledDefinition compiled = result.get();
+    *diagnosticStream() << compiled.ir;
+    if (compiled.object) linkObject(std::move(compiled.object), compiled.names);
+    compilingDefinitions.pop_front();
+  }
+}
+
+void Session::linkObject(JIT::ObjectPtr object,
+                         std::vector<std::string> const& names) {
+  if (snapshotRecorder) snapshotRecorder->addObject(*object->getBinary(), names);
+  jit.addDefinitionObject(std::move(object), names, scope);
+}
+
+void Session::loadSnapshot(Snapshot const& snapshot) {
+  snapshot.load(jit, irgen, scope);
+  updateSizeMetrics();
+}
+
+/// Waits for the given functions, and the functions they call, to be
+/// compiled in the background and linked into the JIT. This is done before
+/// calling any of them, since their stubs don't point to them until then.
+void Session::waitForDefinitions(std::vector<std::string> names) {
+  std::set<std::string> reachable;
+  while (!names.empty()) {
+    std::string name = std::move(names.back());
+    names.pop_back();
+    if (reachable.insert(name).second) {
+      auto callees = dependencies.getCallees(name);
+      names.insert(names.end(), callees.begin(), callees.end());
+    }
+  }
+  
+  size_t count = 0;
+  for (size_t i = 0; i < compilingDefinitions.size(); ++i) {
+    if (reachable.count(compilingDefinitions[i].name)) count = i + 1;
+  }
+  linkDefinitions(count);
+}
+
+/// Generates code for a function definition and queues it to be optimized,
+/// compiled and linked into the JIT in the background, replacing any previous
+/// version of the function. Returns the function's type, or null if code
+/// generation failed.
+llvm::FunctionType* Session::compileDefinition(Function& fn) {
+  // Leave the optimization to the background compiler.
+  irgen.setFnPassManager(nullptr);
+  fn.accept(irgen);
+  irgen.setFnPassManager(fnPassManager.get());
+  auto ir = llvm::cast_or_null<llvm::Function>(irgen.getResult());
+  if (!ir) return nullptr;
+  
+  std::vector<std::string> callees;
+  for (auto& decl : *globalModule) {
+    if (decl.isDeclaration() && !decl.isIntrinsic())
+      callees.push_back(decl.getName());
+  }
+  dependencies.setCallees(ir->getName(), std::move(callees));
+  exprCache.invalidate(ir->getName());
+  
+  llvm::FunctionType* type = ir->getFunctionType();
+  compilingDefinitions.push_back({ir->getName(),
+    backgroundCompiler.compile(*globalModule, options.printIR)});
+  initModuleAndFnPassManager();
+  return type;
+}
+
+/// Recompiles the callers of a function whose signature has changed. Calls
+/// through the function's stub pick up its new definition automatically,
+/// but callers compiled against the old signature would call it wrongly.
+void Session::recompileCallers(std::string const& name,
+                               std::set<std::string>& recompiled) {
+  for (auto const& caller : dependencies.getCallers(name)) {
+    auto iterator = definitions.find(caller);
+    if (iterator == definitions.end() || !recompiled.insert(caller).second)
+      continue;
+    
+    auto& definition = iterator->second;
+    auto type = compileDefinition(*definition.ast);
+    definition.stale = !type;
+    if (type) {
+      // The caller's own signature may depend on the callee's return type.
+      if (type != definition.type) {
+        definition.type = type;
+        recompileCallers(caller, recompiled);
+      }
+    } else {
+      error("'", caller, "' must be redefined to match the new '", name, "'");
+    }
+  }
+}
+
+/// Records the new version of a definition, recompiling its callers if its
+/// signature changed.
+void Session::updateDefinition(std::unique_ptr<Function> fn,
+                               llvm::FunctionType* type) {
+  std::string name = fn->getPrototype()->getName();
+  auto& definition = definitions[name];
+  bool signatureChanged = definition.ast && definition.type != type;
+  definition.hash = hashDefinition(*fn);
+  definition.stale = false;
+  definition.ast = std::move(fn);
+  definition.type = type;
+  
+  if (signatureChanged) {
+    std::set<std::string> recompiled{name};
+    recompileCallers(name, recompiled);
+  }
+  updateSizeMetrics();
+}
+
+/// Returns whether "fn", whose signature has been inferred as "type", is
+/// identical to the session's current definition of the function, and the
+/// latter's compiled code is up to date.
+bool Session::isCurrentDefinition(Function& fn, llvm::FunctionType* type) {
+  auto iterator = definitions.find(fn.getPrototype()->getName());
+  if (iterator == definitions.end()) return false;
+  auto const& definition = iterator->second;
+  // Different definitions can have the same hash, so a match is confirmed
+  // by comparing them.
+  return !definition.stale && definition.type == type &&
+         definition.hash == hashDefinition(fn) &&
+         isSameDefinition(*definition.ast, fn);
+}
+
+void Session::define(std::unique_ptr<Function> fn) {
+  if (auto type = compileDefinition(*fn)) {
+    updateDefinition(std::move(fn), type);
+  }
+}
+
+void Session::define(std::vector<std::unique_ptr<Function>>& fns,
+                     BatchCompiler& batchCompiler) {
+  if (fns.empty()) return;
+  
+  // Infer the signatures serially, since a definition's return type can
+  // depend on the earlier ones. This only generates unoptimized IR, which is
+  // cheap compared to optimization and machine code generation.
+  std::vector<Function*> compilable;
+  std::vector<size_t> indices;
+  std::vector<llvm::FunctionType*> types;
+  std::set<std::string> names; // Of the definitions to compile.
+  irgen.setFnPassManager(nullptr);
+  
+  for (size_t i = 0; i < fns.size(); ++i) {
+    llvm::Module scratchModule("eaxsignatures", llvmContext);
+    irgen.setModule(scratchModule);
+    fns[i]->accept(irgen);
+    
+    if (auto ir = llvm::cast_or_null<llvm::Function>(irgen.getResult())) {
+      // Keep the compiled code of unchanged definitions. The signature is
+      // compared too, since it can change with the functions called. A
+      // definition that follows another of the same function in the script
+      // isn't skipped, since it has to replace the other.
+      auto type = ir->getFunctionType();
+      std::string name = fns[i]->getPrototype()->getName();
+      if (!names.count(name) && isCurrentDefinition(*fns[i], type)) {
+        getMetrics().definitionsReused.increment();
+        continue;
+      }
+      names.insert(name);
+      compilable.push_back(fns[i].get());
+      indices.push_back(i);
+      types.push_back(type);
+    }
+  }
+  
+  irgen.setModule(*globalModule);
+  irgen.setFnPassManager(fnPassManager.get());
+  
+  auto compiled = batchCompiler.compile(compilable, irgen);
+  
+  for (size_t i = 0; i < compiled.size(); ++i) {
+    if (!compiled[i].object) continue;
+    std::string name = compilable[i]->getPrototype()->getName();
+    
+    // Link any recompiled callers of the previous definitions first, so
+    // that they don't replace newer versions of themselves.
+    linkCompiledDefinitions(true);
+    linkObject(std::move(compiled[i].object), compiled[i].names);
+    dependencies.setCallees(name, std::move(compiled[i].callees));
+    exprCache.invalidate(name);
+    updateDefinition(std::move(fns[indices[i]]), types[i]);
+  }
+  
+  fns.clear();
+}
+
+bool Session::evaluate(Function& expr, EvalResult& result) {
+  LatencyTimer latencyTimer(getMetrics().evaluateLatency);
+  auto compiled = compile(expr);
+  if (!compiled || !evaluate(compiled->address, compiled->type, result)) {
+    latencyTimer.cancel();
+    return false;
+  }
+  getMetrics().evaluations.increment();
+  return true;
+}
+
+bool Session::inspect(std::string const& name, CodeInspection& result) {
+  auto iterator = definitions.find(name);
+  if (iterator == definitions.end()) {
+    error("'", name, "' isn't defined in this session");
+    return false;
+  }
+  
+  llvm::Module module("eaxinspect", llvmContext);
+  module.setDataLayout(targetMachine->createDataLayout());
+  irgen.setModule(module);
+  irgen.setFnPassManager(nullptr);
+  iterator->second.ast->accept(irgen);
+  irgen.setModule(*globalModule);
+  irgen.setFnPassManager(fnPassManager.get());
+  if (!irgen.getResult()) return false;
+  
+  result = inspectFunction(module, name, *targetMachine);
+  return true;
+}
+
+CachedExpr const* Session::compile(Function& expr) {
+  // Reuse the compiled function if the same expression has been
+  // evaluated before.
+  AstHasher hasher;
+  expr.getBody().accept(hasher);
+  waitForDefinitions(hasher.getCallees());
+  std::string source = ExprCache::getCanonicalForm(expr.getBody());
+  if (auto cached = exprCache.lookup(hasher.getHash(), source)) {
+    getMetrics().exprCacheHits.increment();
+    return cached;
+  }
+  
+  LatencyTimer latencyTimer(getMetrics().exprCompileLatency);
+  expr.accept(irgen);
+  updateSizeMetrics();
+  auto ir = irgen.getResult();
+  if (!ir) {
+    latencyTimer.cancel();
+    return nullptr;
+  }
+  
+  // Get the type of the expression.
+  llvm::Type* type = ir->getType()->getPointerElementType();
+  type = llvm::cast<llvm::FunctionType>(type)->getReturnType();
+  
+  // Tuples are returned through a function that stores them to an array,
+  // since C++ can't call a function returning an arbitrary struct.
+  std::string symbol = "__anon_expr";
+  if (type->isStructTy()) {
+    symbol = irgen.createTupleWriter(*llvm::cast<llvm::Function>(ir))->getName();
+  }
+  
+  // JIT the module containing the anonymous expression,
+  // keeping a handle so the cache can free it later.
+  auto moduleHandle = jit.addModule(std::move(globalModule), scope);
+  initModuleAndFnPassManager();
+  
+  auto address = jit.getSymbolAddressIn(moduleHandle, symbol);
+  assert(address && "function not found");
+  
+  return exprCache.insert(hasher.getHash(), {moduleHandle, address, type,
+                                            hasher.getCallees(), std::move(source)});
+}
@@ -0,0 +1,157 @@
+#ifndef EAX_SESSION_H
+#define EAX_SESSION_H
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include "jit.h"
+#include "background_compiler.h"
+#include "batch_compiler.h"
+#include "code_inspector.h"
+#include "dependency_graph.h"
+#include "expr_cache.h"
+#include "result_writer.h"
+#include "snapshot.h"
+#include "../ast/function.h"
+#include "../ir_gen/ir_gen.h"
+
+namespace eax {
+
+/// Options shared by the sessions of an Engine.
+struct SessionOptions {
+  llvm::FastMathFlags fastMathFlags;
+  size_t exprCacheSize = 256;
+  bool printIR = false; // Print the optimized IR of definitions as they're linked.
+  bool profileCalls = false; // Instrument the generated code for CallProfiler.
+  bool keepFramePointers = false; // For walking stacks in SamplingProfiler.
+  bool pgoInstrument = false; // Count branches and calls for a PGO profile.
+  Profile const* pgoProfile = nullptr; // The PGO profile to optimize with, if any.
+};
+
+/// A set of definitions, along with the state needed to compile more of them
+/// and to evaluate expressions that call them. Each session has a scope of
+/// its own in the shared JIT, so different sessions can define functions of
+/// the same name. Different sessions can be used concurrently, but each
+/// session only from one thread at a time.
+class Session {
+public:
+  /// Creates a session whose definitions are bound in "scope" of the JIT.
+  /// Expressions and definitions can also call the definitions of "prelude",
+  /// which must not change while this session exists.
+  Session(JIT& jit, std::string scope, SessionOptions const& options,
+          Session const* prelude = nullptr);
+  Session(Session const&) = delete;
+  Session& operator=(Session const&) = delete;
+  ~Session();
+  
+  /// Compiles a definition in the background, replacing any previous
+  /// version of the function once it's done. Calls to the function wait for
+  /// it to be done.
+  void define(std::unique_ptr<Function> fn);
+  
+  /// Compiles consecutive definitions of a script in parallel, and links
+  /// them in order. Definitions that are identical to the session's current
+  /// ones are skipped, so that running a changed version of a script again
+  /// only recompiles the definitions that changed and their callers. Clears
+  /// "fns".
+  void define(std::vector<std::unique_ptr<Function>>& fns,
+              BatchCompiler& batchCompiler);
+  
+  /// Evaluates a top-level expression that has been parsed into an
+  /// anonymous function. Returns false if it couldn't be compiled or its
+  /// type can't be evaluated.
+  bool evaluate(Function& expr, EvalResult& result);
+  
+  /// Compiles a top-level expression like evaluate(), or finds it in the
+  /// cache, without running it. Returns null if it couldn't be compiled. The
+  /// result is valid until the next expression is compiled or a definition
+  /// is changed.
+  CachedExpr const* compile(Function& expr);
+  
+  /// Compiles the session's current definition of a function again, and
+  /// records its IR before and after optimization, its machine code and the
+  /// optimization remarks. Returns false if there's no such definition.
+  bool inspect(std::string const& name, CodeInspection& result);
+  
+  /// Links the definitions that have been compiled in the background. If
+  /// "wait" is set, waits for all of them, otherwise only links the ones that
+  /// are already done.
+  void linkCompiledDefinitions(bool wait);
+  
+  /// Links the definitions of a snapshot, which must outlive the session.
+  void loadSnapshot(Snapshot const& snapshot);
+  
+  /// Records the object code of the definitions linked from now on, e.g. to
+  /// write a snapshot of the session, or stops recording if null.
+  void setSnapshotRecorder(Snapshot* snapshot) { snapshotRecorder = snapshot; }
+  
+  size_t getNumDefinitions() const { return definitions.size(); }
+  size_t getNumCachedExprs() const { return exprCache.size(); }
+  IrGen const& getIrGen() const { return irgen; }
+  
+private:
+  /// A function definition of the session. The AST is kept so that the
+  /// function can be recompiled when a function it calls changes its
+  /// signature.
+  struct Definition {
+    std::unique_ptr<Function> ast;
+    llvm::FunctionType* type;
+    size_t hash; // Of the AST, see AstHasher.
+    bool stale; // Whether recompiling it for a changed callee failed.
+  };
+  
+  /// A definition being compiled by the BackgroundCompiler.
+  struct CompilingDefinition {
+    std::string name;
+    std::future<CompiledDefinition> result;
+  };
+  
+  void initModuleAndFnPassManager();
+  void updateSizeMetrics();
+  void linkDefinitions(size_t count);
+  void linkObject(JIT::ObjectPtr object, std::vector<std::string> const& names);
+  void waitForDefinitions(std::vector<std::string> names);
+  llvm::FunctionType* compileDefinition(Function& fn);
+  void recompileCallers(std::string const& name, std::set<std::string>& recompiled);
+  void updateDefinition(std::unique_ptr<Function> fn, llvm::FunctionType* type);
+  bool isCurrentDefinition(Function& fn, llvm::FunctionType* type);
+  bool evaluate(llvm::orc::TargetAddress addr, llvm::Type* type, EvalResult& result);
+  
+private:
+  JIT& jit;
+  std::string const scope;
+  SessionOptions const options;
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  llvm::LLVMContext llvmContext; // Must outlive irgen and globalModule.
+  IrGen irgen;
+  std::unique_ptr<llvm::Module> globalModule;
+  std::unique_ptr<llvm::legacy::FunctionPassManager> fnPassManager;
+  std::unordered_map<std::string, Definition> definitions;
+  DependencyGraph dependencies;
+  ExprCache exprCache;
+  BackgroundCompiler backgroundCompiler;
+  
+  /// Linked into the JIT in the order they were submitted, so that a later
+  /// version of a function always replaces an earlier one.
+  std::deque<CompilingDefinition> compilingDefinitions;
+  
+  Snapshot* snapshotRecorder = nullptr;
+  
+  /// The sizes last added to the metrics, see updateSizeMetrics().
+  size_t reportedDefinitions = 0;
+  size_t reportedPrototypes = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Type.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "snapshot.h"
+#include "../util/error.h"
+
+using namespace eax;
+namespace endian = llvm::support::endian;
+
+// The file starts with the magic number and the key, followed by the
+// signatures and the objects. Integers are little-endian. Each object's code
+// is aligned, since it is parsed in place from the mapped file.
+static char const magic[] = "EAXSNAP2";
+static size_t const magicSize = sizeof(magic) - 1;
+static uint64_t const objectAlignment = 16;
+
+/// Encodes a return type as a letter per value: 'b' for Bool and 'd' for
+/// Number. Tuples have several.
+static std::string encodeType(llvm::Type* type) {
+  if (auto tupleType = llvm::dyn_cast<llvm::StructType>(type)) {
+    std::string code;
+    for (auto elementType : tupleType->elements()) {
+      code += encodeType(elementType);
+    }
+    return code;
+  }
+  return type->isIntegerTy(1) ? "b" : "d";
+}
+
+static bool isValidTypeCode(llvm::StringRef code) {
+  return !code.empty() && code.find_first_not_of("bd") == llvm::StringRef::npos;
+}
+
+/// Decodes a type encoded by encodeType().
+static llvm::Type* decodeType(llvm::StringRef code, llvm::LLVMContext& context) {
+  std::vector<llvm::Type*> types;
+  for (char letter : code) {
+    types.push_back(letter == 'b' ? llvm::Type::getInt1Ty(context)
+                                  : llvm::Type::getDoubleTy(context));
+  }
+  if (types.size() == 1) return types.front();
+  return llvm::StructType::get(context, types);
+}
+
+static void writeString(endian::Writer<llvm::support::little>& writer,
+                        llvm::StringRef string) {
+  writer.write(uint32_t(string.size()));
+  writer.OS << string;
+}
+
+uint64_t Snapshot::computeKey(llvm::ArrayRef<llvm::StringRef> inputs) {
+  // 64-bit FNV-1a, over each input and its size.
+  uint64_t key = 14695981039346656037u;
+  auto hash = [&](llvm::StringRef bytes) {
+    for (unsigned char byte : bytes) {
+      key = (key ^ byte) * 1099511628211u;
+    }
+  };
+  
+  for (auto input : inputs) {
+    hash(input);
+    hash(std::to_string(input.size()));
+  }
+  return key;
+}
+
+void Snapshot::addObject(llvm::object::ObjectFile const& object,
+                         std::vector<std::string> const& names) {
+  recordedCode.push_back(object.getData());
+  objects.push_back({names, recordedCode.back()});
+}
+
+bool Snapshot::write(std::string const& path, uint64_t key,
+                     IrGen const& irgen) const {
+  std::error_code ec;
+  llvm::raw_fd_ostream out(path, ec, llvm::sys::fs::F_None);
+  if (ec) {
+    error("couldn't write snapshot '", path, "': ", ec.message());
+    return false;
+  }
+  endian::Writer<llvm::support::little> writer(out);
+  
+  out << magic;
+  writer.write(key);
+  
+  auto signatures = irgen.getSignatures();
+  writer.write(uint32_t(signatures.size()));
+  for (auto const& signature : signatures) {
+    writeString(writer, signature.first->getName());
+    writeString(writer, encodeType(signature.second));
+    writer.write(uint32_t(signature.first->getParamNames().size()));
+    for (auto const& paramName : signature.first->getParamNames()) {
+      writeString(writer, paramName);
+    }
+  }
+  
+  writer.write(uint32_t(objects.size()));
+  for (auto const& object : objects) {
+    writer.write(uint32_t(object.names.size()));
+    for (auto const& name : object.names) {
+      writeString(writer, name);
+    }
+    writer.write(uint64_t(object.code.size()));
+    out.indent(llvm::alignTo(out.tell(), objectAlignment) - out.tell());
+    out << object.code;
+  }
+  
+  return !out.has_error();
+}
+
+namespace {
+
+/// Reads the fields of a snapshot file, checking that they're in bounds.
+class Reader {
+public:
+  Reader(llvm::StringRef data) : data(data), position(0) {}
+  
+  bool read(uint64_t& value) { return readInt(value, 8); }
+  bool read(uint32_t& value) { return readInt(value, 4); }
+  bool read(uint8_t& value) { return readInt(value, 1); }
+  
+  bool read(llvm::StringRef& string, uint64_t size) {
+    if (size > data.size() - position) return false;
+    string = data.substr(position, size);
+    position += size;
+    return true;
+  }
+  
+  bool read(std::string& string) {
+    uint32_t size;
+    llvm::StringRef ref;
+    if (!read(size) || !read(ref, size)) return false;
+    string = ref;
+    return true;
+  }
+  
+  bool align(uint64_t alignment) {
+    uint64_t aligned = llvm::alignTo(position, alignment);
+    if (aligned > data.size()) return false;
+    position = aligned;
+    return true;
+  }
+  
+private:
+  template<typename T>
+  bool readInt(T& value, size_t size) {
+    if (size > data.size() - position) return false;
+    value = endian::read<T, llvm::support::little, 1>(data.data() + position);
+    position += size;
+    return true;
+  }
+  
+private:
+  llvm::StringRef data;
+  size_t position;
+};
+
+}
+
+std::unique_ptr<Snapshot> Snapshot::read(std::string const& path, uint64_t key) {
+  // Map the file rather than reading it, so that only the pages of the
+  // objects being linked are touched.
+  auto buffer = llvm::MemoryBuffer::getFile(path, -1, false);
+  if (!buffer) return nullptr;
+  
+  auto snapshot = llvm::make_unique<Snapshot>();
+  snapshot->file = std::move(*buffer);
+  Reader reader(snapshot->file->getBuffer());
+  
+  llvm::StringRef fileMagic;
+  uint64_t fileKey;
+  if (!reader.read(fileMagic, magicSize) || fileMagic != magic ||
+      !reader.read(fileKey) || fileKey != key) {
+    return nullptr;
+  }
+  
+  uint32_t numSignatures;
+  if (!reader.read(numSignatures)) return nullptr;
+  for (uint32_t i = 0; i < numSignatures; ++i) {
+    Signature signature;
+    uint32_t numParams;
+    if (!reader.read(signature.name) || !reader.read(signature.returnType) ||
+        !isValidTypeCode(signature.returnType) || !reader.read(numParams)) {
+      return nullptr;
+    }
+    signature.paramNames.resize(numParams);
+    for (auto& paramName : signature.paramNames) {
+      if (!reader.read(paramName)) return nullptr;
+    }
+    snapshot->signatures.push_back(std::move(signature));
+  }
+  
+  uint32_t numObjects;
+  if (!reader.read(numObjects)) return nullptr;
+  for (uint32_t i = 0; i < numObjects; ++i) {
+    Object object;
+    uint32_t numNames;
+    uint64_t size;
+    if (!reader.read(numNames)) return nullptr;
+    object.names.resize(numNames);
+    for (auto& name : object.names) {
+      if (!reader.read(name)) return nullptr;
+    }
+    if (!reader.read(size) || !reader.align(objectAlignment) ||
+        !reader.read(object.code, size)) {
+      return nullptr;
+    }
+    snapshot->objects.push_back(std::move(object));
+  }
+  
+  return snapshot;
+}
+
+void Snapshot::load(JIT& jit, IrGen& irgen, std::string const& scope) const {
+  auto& context = irgen.getContext();
+  for (auto const& signature : signatures) {
+    irgen.addSignature(Prototype(signature.name, signature.paramNames),
+                       decodeType(signature.returnType, context));
+  }
+  
+  for (auto const& object : objects) {
+    // The object is parsed in place, without copying it out of the snapshot.
+    auto buffer = llvm::MemoryBuffer::getMemBuffer(object.code, "eaxsnapshot",
+                                                   false);
+    auto objectFile = llvm::object::ObjectFile::createObjectFile(
+      buffer->getMemBufferRef());
+    if (!objectFile) {
+      llvm::consumeError(objectFile.takeError());
+      error("snapshot contains an invalid object for '", object.names.front(), "'");
+      continue;
+    }
+    
+    jit.addDefinitionObject(
+      llvm::make_unique<llvm::object::OwningBinary<llvm::object::ObjectFile>>(
+        std::move(*objectFile), std::move(buffer)),
+      object.names, scope);
+  }
+}
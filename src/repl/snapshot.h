@@ -0,0 +1,70 @@
+#ifndef EAX_SNAPSHOT_H
+#define EAX_SNAPSHOT_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "jit.h"
+#include "../ast/prototype.h"
+#include "../ir_gen/ir_gen.h"
+
+namespace eax {
+
+/// A precompiled set of definitions, e.g. a prelude, that can be linked into
+/// the JIT without parsing or compiling it again: the signatures of its
+/// functions, and the object code of its definitions in the order they were
+/// linked. A snapshot read from a file links its objects straight from the
+/// memory-mapped file.
+class Snapshot {
+public:
+  /// Returns a key identifying the given inputs, e.g. the source code and a
+  /// description of the target. Unlike llvm::hash_code, it's the same in
+  /// every process.
+  static uint64_t computeKey(llvm::ArrayRef<llvm::StringRef> inputs);
+  
+  /// Records the object code of definitions that have been linked.
+  void addObject(llvm::object::ObjectFile const& object,
+                 std::vector<std::string> const& names);
+  
+  /// Writes the recorded objects and the signatures known to "irgen" to a
+  /// file. "key" identifies the source and target the code was compiled for.
+  bool write(std::string const& path, uint64_t key, IrGen const& irgen) const;
+  
+  /// Maps a snapshot file written with the same key. Returns null if the
+  /// file doesn't exist, is malformed, or has a different key.
+  static std::unique_ptr<Snapshot> read(std::string const& path, uint64_t key);
+  
+  /// Makes the snapshot's functions callable from code generated by "irgen",
+  /// and links its objects into the JIT in "scope". The snapshot must outlive
+  /// the objects' modules in the JIT.
+  void load(JIT& jit, IrGen& irgen, std::string const& scope) const;
+  
+private:
+  struct Signature {
+    std::string name;
+    std::vector<std::string> paramNames;
+    std::string returnType; // See encodeType() in snapshot.cpp.
+  };
+  
+  struct Object {
+    std::vector<std::string> names; // For JIT::addDefinitionObject().
+    llvm::StringRef code;
+  };
+  
+private:
+  std::unique_ptr<llvm::MemoryBuffer> file; // If read from a file.
+  std::deque<std::string> recordedCode; // If recorded; referenced by "objects".
+  std::vector<Signature> signatures;
+  std::vector<Object> objects;
+};
+
+}
+
+#endif
@@ -0,0 +1,16 @@
+#include <llvm/Config/llvm-config.h>
+
+#include "build_info.h"
+
+using namespace eax;
+
+// Set by the build system.
+#ifndef EAX_BUILD_VERSION
+#define EAX_BUILD_VERSION "unknown"
+#endif
+
+std::string const& eax::getBuildID() {
+  static std::string const buildID =
+    "eax " EAX_BUILD_VERSION ", LLVM " LLVM_VERSION_STRING;
+  return buildID;
+}
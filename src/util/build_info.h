@@ -0,0 +1,17 @@
+#ifndef EAX_BUILD_INFO_H
+#define EAX_BUILD_INFO_H
+
+#include <string>
+
+namespace eax {
+
+/// Returns a string identifying this build of eax and the LLVM version it's
+/// built with. Files that depend on the generated code, like snapshots and
+/// PGO profiles, record it, so that they're rejected by other builds. The
+/// eax version is determined when the build is configured, from
+/// "git describe" where available.
+std::string const& getBuildID();
+
+}
+
+#endif
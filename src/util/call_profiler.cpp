@@ -0,0 +1,241 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Support/DynamicLibrary.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "call_profiler.h"
+#include "error.h"
+
+using namespace eax;
+
+char const CallProfiler::enterFunctionName[] = "eax_profile_enter";
+char const CallProfiler::exitFunctionName[] = "eax_profile_exit";
+
+namespace {
+
+/// The counts of a function in one thread. Only the thread itself writes
+/// them, so they're updated without atomic read-modify-writes; they're
+/// atomic so that other threads can read them while they're being updated.
+struct Counters {
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> inclusiveCycles;
+  std::atomic<uint64_t> exclusiveCycles;
+  uint32_t depth; // Number of active calls, only used by the thread itself.
+};
+
+struct Frame {
+  uint32_t id;
+  uint64_t startCycles;
+  uint64_t calleeCycles;
+};
+
+/// The counters of a thread, indexed by function id. They're allocated in
+/// chunks as functions are called, so that the counters of functions called
+/// earlier never move while another thread reads them.
+class ThreadCounters {
+public:
+  static size_t const chunkSize = 256;
+  static size_t const maxChunks = 4096;
+  
+  ~ThreadCounters() {
+    for (auto& chunk : chunks) delete[] chunk.load();
+  }
+  
+  Counters& operator[](uint32_t id) {
+    auto& chunk = chunks[id / chunkSize];
+    Counters* counters = chunk.load(std::memory_order_relaxed);
+    if (!counters) {
+      counters = new Counters[chunkSize]();
+      chunk.store(counters, std::memory_order_release);
+    }
+    return counters[id % chunkSize];
+  }
+  
+  /// Returns the counters of a function, or null if this thread hasn't
+  /// called it. Can be called from any thread.
+  Counters const* find(uint32_t id) const {
+    auto counters = chunks[id / chunkSize].load(std::memory_order_acquire);
+    return counters ? &counters[id % chunkSize] : nullptr;
+  }
+  
+  std::vector<Frame> frames; // The active calls of instrumented functions.
+  
+private:
+  std::atomic<Counters*> chunks[maxChunks]{};
+};
+
+/// The counters of all threads that have called instrumented code. When a
+/// thread exits, its counters are kept, and reused by the next new thread.
+std::mutex threadCountersMutex;
+std::vector<std::unique_ptr<ThreadCounters>> allThreadCounters;
+std::vector<ThreadCounters*> unusedThreadCounters;
+
+struct ThreadCountersLease {
+  ThreadCounters* counters = nullptr;
+  
+  ~ThreadCountersLease() {
+    if (!counters) return;
+    std::lock_guard<std::mutex> lock(threadCountersMutex);
+    unusedThreadCounters.push_back(counters);
+  }
+};
+
+thread_local ThreadCountersLease threadCountersLease;
+
+}
+
+static ThreadCounters& getThreadCounters() {
+  if (auto counters = threadCountersLease.counters) return *counters;
+  
+  std::lock_guard<std::mutex> lock(threadCountersMutex);
+  if (unusedThreadCounters.empty()) {
+    allThreadCounters.push_back(llvm::make_unique<ThreadCounters>());
+    threadCountersLease.counters = allThreadCounters.back().get();
+  } else {
+    threadCountersLease.counters = unusedThreadCounters.back();
+    unusedThreadCounters.pop_back();
+  }
+  return *threadCountersLease.counters;
+}
+
+static uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+/// Adds to a counter that only the current thread writes.
+static void add(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+static uint32_t const noFunctionId = ~0u;
+
+extern "C" void eax_profile_enter(uint32_t* idSlot, char const* name) {
+  uint32_t id = __atomic_load_n(idSlot, __ATOMIC_RELAXED);
+  if (id == noFunctionId) {
+    id = CallProfiler::get().getFunctionId(name);
+    __atomic_store_n(idSlot, id, __ATOMIC_RELAXED);
+  }
+  
+  auto& thread = getThreadCounters();
+  Counters& counters = thread[id];
+  add(counters.calls, 1);
+  ++counters.depth;
+  thread.frames.push_back({id, readCycleCounter(), 0});
+}
+
+extern "C" void eax_profile_exit() {
+  uint64_t endCycles = readCycleCounter();
+  auto& thread = getThreadCounters();
+  Frame frame = thread.frames.back();
+  thread.frames.pop_back();
+  
+  uint64_t cycles = endCycles - frame.startCycles;
+  Counters& counters = thread[frame.id];
+  add(counters.exclusiveCycles, cycles - frame.calleeCycles);
+  // Count the time of recursive calls only once, in the outermost call.
+  if (--counters.depth == 0) add(counters.inclusiveCycles, cycles);
+  if (!thread.frames.empty()) thread.frames.back().calleeCycles += cycles;
+}
+
+CallProfiler::CallProfiler() {
+  llvm::sys::DynamicLibrary::AddSymbol(
+    enterFunctionName, reinterpret_cast<void*>(&eax_profile_enter));
+  llvm::sys::DynamicLibrary::AddSymbol(
+    exitFunctionName, reinterpret_cast<void*>(&eax_profile_exit));
+}
+
+CallProfiler& CallProfiler::get() {
+  static CallProfiler profiler;
+  return profiler;
+}
+
+uint32_t CallProfiler::getFunctionId(llvm::StringRef name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto iterator = functionIds.find(name.str());
+  if (iterator != functionIds.end()) return iterator->second;
+  
+  if (functionNames.size() == ThreadCounters::chunkSize * ThreadCounters::maxChunks) {
+    fatalError("too many functions to profile");
+  }
+  uint32_t id = uint32_t(functionNames.size());
+  functionNames.push_back(name.str());
+  functionIds.emplace(name.str(), id);
+  return id;
+}
+
+std::vector<CallProfiler::Totals> CallProfiler::sumThreadCounters() const {
+  std::vector<Totals> totals(functionNames.size());
+  std::lock_guard<std::mutex> lock(threadCountersMutex);
+  
+  for (auto const& thread : allThreadCounters) {
+    for (uint32_t id = 0; id < totals.size(); ++id) {
+      if (auto counters = thread->find(id)) {
+        totals[id].calls += counters->calls.load(std::memory_order_relaxed);
+        totals[id].inclusiveCycles += counters->inclusiveCycles.load(std::memory_order_relaxed);
+        totals[id].exclusiveCycles += counters->exclusiveCycles.load(std::memory_order_relaxed);
+      }
+    }
+  }
+  
+  return totals;
+}
+
+std::vector<CallProfiler::Entry> CallProfiler::getProfile() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto totals = sumThreadCounters();
+  std::vector<Entry> profile;
+  
+  for (uint32_t id = 0; id < totals.size(); ++id) {
+    Totals base = id < baseline.size() ? baseline[id] : Totals();
+    if (totals[id].calls == base.calls) continue;
+    profile.push_back({functionNames[id],
+                       totals[id].calls - base.calls,
+                       totals[id].inclusiveCycles - base.inclusiveCycles,
+                       totals[id].exclusiveCycles - base.exclusiveCycles});
+  }
+  
+  std::sort(profile.begin(), profile.end(), [](Entry const& a, Entry const& b) {
+    return a.exclusiveCycles > b.exclusiveCycles;
+  });
+  return profile;
+}
+
+void CallProfiler::printProfile(std::ostream& out) const {
+  auto profile = getProfile();
+  uint64_t totalCycles = 0;
+  size_t nameWidth = 8;
+  for (auto const& entry : profile) {
+    totalCycles += entry.exclusiveCycles;
+    nameWidth = std::max(nameWidth, entry.name.size());
+  }
+  
+  auto flags = out.flags();
+  out << std::left << std::setw(nameWidth) << "function" << std::right
+      << std::setw(12) << "calls" << std::setw(18) << "incl. cycles"
+      << std::setw(18) << "excl. cycles" << std::setw(8) << "excl. %" << '\n';
+  for (auto const& entry : profile) {
+    double percentage = totalCycles ? 100.0 * entry.exclusiveCycles / totalCycles : 0;
+    out << std::left << std::setw(nameWidth) << entry.name << std::right
+        << std::setw(12) << entry.calls
+        << std::setw(18) << entry.inclusiveCycles
+        << std::setw(18) << entry.exclusiveCycles
+        << std::setw(8) << std::fixed << std::setprecision(1) << percentage << '\n';
+  }
+  out.flush();
+  out.flags(flags);
+}
+
+void CallProfiler::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  baseline = sumThreadCounters();
+}
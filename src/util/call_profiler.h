@@ -0,0 +1,81 @@
+#ifndef EAX_CALL_PROFILER_H
+#define EAX_CALL_PROFILER_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+namespace eax {
+
+/// Counts the calls of instrumented JIT-compiled functions and the CPU
+/// cycles spent in them, both including and excluding the functions they
+/// call. Each thread counts into a table of its own without locking; the
+/// tables are only summed up when the profile is read. Functions are
+/// identified by name, so the versions of a redefined function, or the
+/// functions of the same name in different sessions, add up.
+///
+/// Instrumented code calls these C functions, which the profiler makes
+/// visible to the JIT:
+///
+///   void eax_profile_enter(uint32_t* id, char const* name);
+///   void eax_profile_exit();
+///
+/// "id" points to a slot in the function's module, initially ~0u, where the
+/// first call caches the id of "name", so that code can be compiled without
+/// knowing the ids, e.g. into a snapshot.
+class CallProfiler {
+public:
+  struct Entry {
+    std::string name;
+    uint64_t calls;
+    uint64_t inclusiveCycles; // Not counting recursive calls twice.
+    uint64_t exclusiveCycles;
+  };
+  
+  static char const enterFunctionName[];
+  static char const exitFunctionName[];
+  
+  /// Returns the process's profiler.
+  static CallProfiler& get();
+  
+  /// Returns the counts of each function called since the last reset,
+  /// sorted by exclusive cycles, highest first.
+  std::vector<Entry> getProfile() const;
+  
+  /// Prints the profile as a table.
+  void printProfile(std::ostream& out) const;
+  
+  /// Starts counting from zero again.
+  void reset();
+  
+  /// Returns the id under which the calls of "name" are counted.
+  uint32_t getFunctionId(llvm::StringRef name);
+  
+private:
+  struct Totals {
+    uint64_t calls = 0;
+    uint64_t inclusiveCycles = 0;
+    uint64_t exclusiveCycles = 0;
+  };
+  
+  CallProfiler();
+  
+  /// Returns the counts of each function since the program started.
+  /// Must be called with "mutex" locked.
+  std::vector<Totals> sumThreadCounters() const;
+  
+private:
+  mutable std::mutex mutex;
+  std::vector<std::string> functionNames; // Indexed by id.
+  std::unordered_map<std::string, uint32_t> functionIds;
+  std::vector<Totals> baseline; // The counts at the last reset.
+};
+
+}
+
+#endif
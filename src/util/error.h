@@ -6,18 +6,28 @@
 
 namespace eax {
 
-/// Prints the arguments to stderr and returns nullptr.
+/// Returns the stream that error() prints to on the current thread, which
+/// is stderr unless it's been redirected, e.g. to collect the diagnostics of
+/// a worker thread and print them in a deterministic order.
+inline std::ostream*& diagnosticStream() {
+  static thread_local std::ostream* stream = &std::cerr;
+  return stream;
+}
+
+/// Prints the arguments to the diagnostic stream and returns nullptr.
 template<typename... Ts>
 std::nullptr_t error(Ts&&... args) {
+  std::ostream& out = *diagnosticStream();
   using expander = int[];
-  (void)expander{0, (void(std::cerr << std::forward<Ts>(args)), 0)...};
-  std::cerr << std::endl;
+  (void)expander{0, (void(out << std::forward<Ts>(args)), 0)...};
+  out << std::endl;
   return nullptr;
 }
 
 /// Prints the arguments to stderr and aborts the program.
 template<typename... Ts>
 [[noreturn]] void fatalError(Ts&&... args) {
+  diagnosticStream() = &std::cerr; // Make sure the message isn't lost.
   error(std::forward<Ts>(args)...);
   std::exit(1);
 }
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <llvm/ADT/STLExtras.h>
+
+#include "metrics.h"
+#include "error.h"
+
+using namespace eax;
+
+/// Adds to an atomic double, which has no fetch_add() before C++20.
+static void add(std::atomic<double>& value, double amount) {
+  double expected = value.load(std::memory_order_relaxed);
+  while (!value.compare_exchange_weak(expected, expected + amount,
+                                      std::memory_order_relaxed)) {}
+}
+
+void Gauge::add(double amount) {
+  ::add(value, amount);
+}
+
+Histogram::Histogram(std::vector<double> bounds)
+  : bounds(std::move(bounds)),
+    counts(new std::atomic<uint64_t>[this->bounds.size() + 1]()) {}
+
+void Histogram::observe(double value) {
+  auto bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+  counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  ::add(sum, value);
+}
+
+std::vector<uint64_t> Histogram::getBucketCounts() const {
+  std::vector<uint64_t> result(bounds.size() + 1);
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i] = counts[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
+std::vector<double> Histogram::getLatencyBounds() {
+  return {0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005,
+          0.01, 0.05, 0.1, 0.5, 1, 5, 10};
+}
+
+Metrics& Metrics::get() {
+  static Metrics metrics;
+  return metrics;
+}
+
+Metrics::Metric& Metrics::getMetric(std::string const& name,
+                                    std::string const& help) {
+  auto& metric = metrics[name];
+  if (metric.help.empty()) metric.help = help;
+  return metric;
+}
+
+Counter& Metrics::getCounter(std::string const& name, std::string const& help) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& metric = getMetric(name, help);
+  if (!metric.counter) {
+    if (metric.gauge || metric.histogram) fatalError("metric '", name, "' isn't a counter");
+    metric.counter = llvm::make_unique<Counter>();
+  }
+  return *metric.counter;
+}
+
+Gauge& Metrics::getGauge(std::string const& name, std::string const& help) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& metric = getMetric(name, help);
+  if (!metric.gauge) {
+    if (metric.counter || metric.histogram) fatalError("metric '", name, "' isn't a gauge");
+    metric.gauge = llvm::make_unique<Gauge>();
+  }
+  return *metric.gauge;
+}
+
+Histogram& Metrics::getHistogram(std::string const& name, std::string const& help,
+                                 std::vector<double> bounds) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& metric = getMetric(name, help);
+  if (!metric.histogram) {
+    if (metric.counter || metric.gauge) fatalError("metric '", name, "' isn't a histogram");
+    metric.histogram = llvm::make_unique<Histogram>(std::move(bounds));
+  }
+  return *metric.histogram;
+}
+
+size_t Metrics::addCollector(std::function<void()> collector) {
+  std::lock_guard<std::mutex> lock(collectorsMutex);
+  collectors.emplace(nextCollectorID, std::move(collector));
+  return nextCollectorID++;
+}
+
+void Metrics::removeCollector(size_t id) {
+  std::lock_guard<std::mutex> lock(collectorsMutex);
+  collectors.erase(id);
+}
+
+void Metrics::runCollectors() {
+  std::lock_guard<std::mutex> lock(collectorsMutex);
+  for (auto const& collector : collectors) {
+    collector.second();
+  }
+}
+
+/// Prints integral values without an exponent, and others with enough
+/// digits to be useful.
+static void printValue(std::ostream& out, double value) {
+  if (value == std::floor(value) && std::abs(value) < 1e15) {
+    out << int64_t(value);
+  } else {
+    auto precision = out.precision(15);
+    out << value;
+    out.precision(precision);
+  }
+}
+
+/// Returns an upper bound of the given quantile of a histogram's values:
+/// the upper bound of the bucket that contains it, or infinity.
+static double getQuantileBound(Histogram const& histogram,
+                               std::vector<uint64_t> const& counts,
+                               uint64_t total, double quantile) {
+  uint64_t rank = uint64_t(std::ceil(quantile * total));
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    cumulative += counts[i];
+    if (cumulative >= rank && i < histogram.getBounds().size()) {
+      return histogram.getBounds()[i];
+    }
+  }
+  return INFINITY;
+}
+
+void Metrics::printTable(std::ostream& out) {
+  runCollectors();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  size_t nameWidth = 6;
+  for (auto const& entry : metrics) {
+    nameWidth = std::max(nameWidth, entry.first.size());
+  }
+  
+  for (auto const& entry : metrics) {
+    auto const& metric = entry.second;
+    out << std::left << std::setw(nameWidth) << entry.first << std::right << "  ";
+    if (metric.counter) {
+      printValue(out, metric.counter->getValue());
+    } else if (metric.gauge) {
+      printValue(out, metric.gauge->getValue());
+    } else {
+      auto counts = metric.histogram->getBucketCounts();
+      uint64_t total = 0;
+      for (auto count : counts) total += count;
+      out << "count ";
+      printValue(out, total);
+      if (total > 0) {
+        out << ", mean ";
+        printValue(out, metric.histogram->getSum() / total);
+        out << ", p50 <= ";
+        printValue(out, getQuantileBound(*metric.histogram, counts, total, 0.5));
+        out << ", p99 <= ";
+        printValue(out, getQuantileBound(*metric.histogram, counts, total, 0.99));
+      }
+    }
+    out << '\n';
+  }
+  out.flush();
+}
+
+void Metrics::printPrometheus(std::ostream& out) {
+  runCollectors();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  for (auto const& entry : metrics) {
+    auto const& name = entry.first;
+    auto const& metric = entry.second;
+    out << "# HELP " << name << ' ' << metric.help << '\n';
+    if (metric.counter) {
+      out << "# TYPE " << name << " counter\n" << name << ' ';
+      printValue(out, metric.counter->getValue());
+      out << '\n';
+    } else if (metric.gauge) {
+      out << "# TYPE " << name << " gauge\n" << name << ' ';
+      printValue(out, metric.gauge->getValue());
+      out << '\n';
+    } else {
+      out << "# TYPE " << name << " histogram\n";
+      auto const& bounds = metric.histogram->getBounds();
+      auto counts = metric.histogram->getBucketCounts();
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < counts.size(); ++i) {
+        cumulative += counts[i];
+        out << name << "_bucket{le=\"";
+        if (i < bounds.size()) printValue(out, bounds[i]);
+        else out << "+Inf";
+        out << "\"} " << cumulative << '\n';
+      }
+      out << name << "_sum ";
+      printValue(out, metric.histogram->getSum());
+      out << '\n' << name << "_count " << cumulative << '\n';
+    }
+  }
+  out.flush();
+}
+
+bool Metrics::writePrometheus(std::string const& path) {
+  std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath);
+    printPrometheus(file);
+    if (!file) {
+      error("couldn't write metrics to '", temporaryPath, "'");
+      return false;
+    }
+  }
+  
+  if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+    error("couldn't replace '", path, "' with the metrics");
+    std::remove(temporaryPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+MetricsFileWriter::MetricsFileWriter(std::string path, std::chrono::seconds interval)
+  : path(std::move(path)), interval(interval), thread([this] { run(); }) {}
+
+MetricsFileWriter::~MetricsFileWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  stopRequested.notify_one();
+  thread.join();
+  Metrics::get().writePrometheus(path);
+}
+
+void MetricsFileWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopRequested.wait_for(lock, interval, [this] { return stopping; })) {
+    lock.unlock();
+    Metrics::get().writePrometheus(path);
+    lock.lock();
+  }
+}
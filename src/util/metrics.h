@@ -0,0 +1,172 @@
+#ifndef EAX_METRICS_H
+#define EAX_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace eax {
+
+/// A number that only grows, e.g. the number of evaluated expressions.
+class Counter {
+public:
+  void increment(uint64_t amount = 1) {
+    value.fetch_add(amount, std::memory_order_relaxed);
+  }
+  uint64_t getValue() const { return value.load(std::memory_order_relaxed); }
+  
+private:
+  std::atomic<uint64_t> value{0};
+};
+
+/// A number that goes up and down, e.g. the number of live modules.
+class Gauge {
+public:
+  void set(double value) { this->value.store(value, std::memory_order_relaxed); }
+  void add(double amount);
+  double getValue() const { return value.load(std::memory_order_relaxed); }
+  
+private:
+  std::atomic<double> value{0};
+};
+
+/// Counts observed values, e.g. latencies in seconds, in buckets with fixed
+/// upper bounds, and keeps their sum.
+class Histogram {
+public:
+  /// Takes the upper bounds of the buckets in increasing order. A last
+  /// bucket without an upper bound is added implicitly.
+  Histogram(std::vector<double> bounds);
+  
+  void observe(double value);
+  
+  std::vector<double> const& getBounds() const { return bounds; }
+  
+  /// Returns the number of values in each bucket, including the implicit
+  /// last one.
+  std::vector<uint64_t> getBucketCounts() const;
+  double getSum() const { return sum.load(std::memory_order_relaxed); }
+  
+  /// Returns the default bounds for latencies, from 10 us to 10 s.
+  static std::vector<double> getLatencyBounds();
+  
+private:
+  std::vector<double> const bounds;
+  std::unique_ptr<std::atomic<uint64_t>[]> counts;
+  std::atomic<double> sum{0};
+};
+
+/// The metrics of the process: counters, gauges and histograms, each with a
+/// unique name and a description. Metrics are registered on first use, and
+/// live as long as the process, so references to them can be kept. Values
+/// that are expensive to track as they change, e.g. memory usage, can be
+/// computed by collectors instead, which are called before the metrics are
+/// printed. Can be used from any thread.
+class Metrics {
+public:
+  /// Returns the process's metrics.
+  static Metrics& get();
+  
+  /// Returns the metric with the given name, registering it if necessary.
+  /// Names should follow the Prometheus conventions, e.g.
+  /// "eax_evaluate_seconds".
+  Counter& getCounter(std::string const& name, std::string const& help);
+  Gauge& getGauge(std::string const& name, std::string const& help);
+  Histogram& getHistogram(std::string const& name, std::string const& help,
+                          std::vector<double> bounds = Histogram::getLatencyBounds());
+  
+  /// Adds a function to call before the metrics are printed, and returns an
+  /// ID for removing it.
+  size_t addCollector(std::function<void()> collector);
+  void removeCollector(size_t id);
+  
+  /// Prints the value of each metric, and the count, mean and approximate
+  /// median and 99th percentile of each histogram.
+  void printTable(std::ostream& out);
+  
+  /// Prints the metrics in the Prometheus text exposition format.
+  void printPrometheus(std::ostream& out);
+  
+  /// Writes the metrics in the Prometheus text format to a file, replacing
+  /// it atomically so that readers never see a partial file. Reports an
+  /// error and returns false on failure.
+  bool writePrometheus(std::string const& path);
+  
+private:
+  struct Metric {
+    std::string help;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+  
+  Metric& getMetric(std::string const& name, std::string const& help);
+  void runCollectors();
+  
+private:
+  std::mutex mutex;
+  std::map<std::string, Metric> metrics; // By name, in printing order.
+  std::mutex collectorsMutex;
+  std::map<size_t, std::function<void()>> collectors;
+  size_t nextCollectorID = 0;
+};
+
+/// Adds the time between its construction and destruction, in seconds, to
+/// a histogram.
+class LatencyTimer {
+public:
+  using Clock = std::chrono::steady_clock;
+  
+  LatencyTimer(Histogram& histogram)
+    : histogram(&histogram), start(Clock::now()) {}
+  ~LatencyTimer() { stop(); }
+  
+  /// Records the time now rather than on destruction.
+  void stop() {
+    if (!histogram) return;
+    histogram->observe(std::chrono::duration<double>(Clock::now() - start).count());
+    histogram = nullptr;
+  }
+  
+  /// Records nothing, e.g. because the operation failed.
+  void cancel() { histogram = nullptr; }
+  
+private:
+  Histogram* histogram;
+  Clock::time_point start;
+};
+
+/// Writes the metrics to a file in the Prometheus text format periodically,
+/// for collection with e.g. the textfile collector of the node exporter,
+/// and once more when destroyed.
+class MetricsFileWriter {
+public:
+  MetricsFileWriter(std::string path, std::chrono::seconds interval);
+  MetricsFileWriter(MetricsFileWriter const&) = delete;
+  MetricsFileWriter& operator=(MetricsFileWriter const&) = delete;
+  ~MetricsFileWriter();
+  
+private:
+  void run();
+  
+private:
+  std::string const path;
+  std::chrono::seconds const interval;
+  std::mutex mutex;
+  std::condition_variable stopRequested;
+  bool stopping = false;
+  std::thread thread; // Must be initialized last.
+};
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include <fstream>
+#include <llvm/ADT/STLExtras.h>
+
+#include "pgo_profile.h"
+#include "build_info.h"
+#include "error.h"
+
+using namespace eax;
+
+// The version changes with the numbering of the counters; version 2 doesn't
+// count if expressions that are compiled to selects.
+static char const headerPrefix[] = "# eax profile ";
+static char const header[] = "# eax profile 2";
+static char const buildPrefix[] = "# build: ";
+
+ProfileCounters& ProfileCounters::get() {
+  static ProfileCounters counters;
+  return counters;
+}
+
+uint64_t* ProfileCounters::getCounter(llvm::StringRef function, uint64_t checksum,
+                                      unsigned index) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto& functionCounters = counters[ProfileKey(function.str(), checksum)];
+  // Growing a deque at the end doesn't move its elements.
+  if (functionCounters.size() <= index) functionCounters.resize(index + 1);
+  return &functionCounters[index];
+}
+
+bool ProfileCounters::write(std::string const& path) {
+  std::ofstream file(path);
+  file << header << '\n' << buildPrefix << getBuildID() << '\n';
+  
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Each line holds a function's name, checksum, number of counters and
+    // their values.
+    for (auto const& entry : counters) {
+      file << entry.first.first << ' ' << entry.first.second << ' '
+           << entry.second.size();
+      for (uint64_t count : entry.second) file << ' ' << count;
+      file << '\n';
+    }
+  }
+  
+  if (!file) {
+    error("couldn't write the profile '", path, "'");
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<Profile> Profile::read(std::string const& path) {
+  std::ifstream file(path);
+  std::string line;
+  if (!std::getline(file, line) || !llvm::StringRef(line).startswith(headerPrefix)) {
+    error("'", path, "' isn't an eax profile");
+    return nullptr;
+  }
+  if (line != header) {
+    error("the profile '", path, "' has an unsupported format; generate it again");
+    return nullptr;
+  }
+  
+  // The counters are numbered by IrGen, so their numbering may differ
+  // between builds even for the same AST.
+  if (!std::getline(file, line) || !llvm::StringRef(line).startswith(buildPrefix)) {
+    error("the profile '", path, "' is malformed");
+    return nullptr;
+  }
+  std::string build = line.substr(sizeof(buildPrefix) - 1);
+  if (build != getBuildID()) {
+    error("the profile '", path, "' was written by another eax build (", build,
+          "); this is ", getBuildID());
+    return nullptr;
+  }
+  
+  auto profile = llvm::make_unique<Profile>();
+  std::string name;
+  uint64_t checksum;
+  size_t size;
+  while (file >> name >> checksum >> size) {
+    auto& counts = profile->counts[ProfileKey(name, checksum)];
+    if (counts.size() < size) counts.resize(size);
+    for (size_t i = 0; i < size; ++i) {
+      uint64_t count;
+      if (!(file >> count)) break;
+      counts[i] += count;
+    }
+  }
+  
+  if (!file.eof()) {
+    error("the profile '", path, "' is malformed");
+    return nullptr;
+  }
+  return profile;
+}
+
+std::vector<uint64_t> const* Profile::lookup(llvm::StringRef function,
+                                             uint64_t checksum) const {
+  auto iterator = counts.find(ProfileKey(function.str(), checksum));
+  return iterator != counts.end() ? &iterator->second : nullptr;
+}
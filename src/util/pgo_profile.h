@@ -0,0 +1,67 @@
+#ifndef EAX_PGO_PROFILE_H
+#define EAX_PGO_PROFILE_H
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+namespace eax {
+
+/// The execution counts of a function, for profile-guided optimization.
+/// IrGen numbers the points it counts in the order it generates them: the
+/// function's entry is 0, each if expression that's compiled to branches,
+/// rather than a select, has a counter for each branch, and each call of a
+/// user function has one. A function is identified by its
+/// name and a checksum of its AST, so that the counts of an older version of
+/// a function are never applied to a newer one. Checksums are computed with
+/// AstHasher and the counters are numbered by IrGen, so profiles are only
+/// valid for the eax build that wrote them, which Profile::read() checks.
+using ProfileKey = std::pair<std::string, uint64_t>;
+
+/// The counters incremented by instrumented code. Each counter is allocated
+/// when IrGen first asks for it, and its address, which is built into the
+/// generated code, never changes. The counters are incremented without
+/// synchronization, like LLVM's own instrumentation does, so concurrent
+/// calls of a function may lose a few counts.
+class ProfileCounters {
+public:
+  /// Returns the process's counters.
+  static ProfileCounters& get();
+  
+  uint64_t* getCounter(llvm::StringRef function, uint64_t checksum, unsigned index);
+  
+  /// Writes the counts in the format read by Profile::read(). Reports an
+  /// error and returns false on failure.
+  bool write(std::string const& path);
+  
+private:
+  std::mutex mutex;
+  std::map<ProfileKey, std::deque<uint64_t>> counters;
+};
+
+/// The counts of a profile file, for guiding the optimization of the
+/// functions whose ASTs haven't changed since it was written.
+class Profile {
+public:
+  /// Reads a profile written by ProfileCounters::write() of the same eax
+  /// build (see getBuildID()). The counts of functions that appear more than
+  /// once are added. Reports an error and returns null on failure.
+  static std::unique_ptr<Profile> read(std::string const& path);
+  
+  /// Returns the counts of a function, or null if there aren't any.
+  std::vector<uint64_t> const* lookup(llvm::StringRef function, uint64_t checksum) const;
+  
+private:
+  std::map<ProfileKey, std::vector<uint64_t>> counts;
+};
+
+}
+
+#endif
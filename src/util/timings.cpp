@@ -0,0 +1,124 @@
+#include <iomanip>
+
+#include "timings.h"
+
+using namespace eax;
+
+Timings& Timings::get() {
+  static Timings timings;
+  return timings;
+}
+
+Timings::Entry& Timings::PhaseEntries::operator[](llvm::StringRef phase) {
+  for (auto& entry : entries) {
+    if (entry.first == phase) return entry.second;
+  }
+  entries.emplace_back(phase, Entry());
+  return entries.back().second;
+}
+
+void Timings::add(llvm::StringRef definition, llvm::StringRef phase,
+                  Clock::duration duration) {
+  std::string name = definition.empty() ? "<unknown>" : definition.str();
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  auto iterator = definitions.find(name);
+  if (iterator == definitions.end()) {
+    definitionNames.push_back(name);
+    iterator = definitions.emplace(name, PhaseEntries()).first;
+  }
+  
+  for (Entry* entry : {&iterator->second[phase], &total[phase]}) {
+    ++entry->count;
+    entry->duration += duration;
+  }
+}
+
+void Timings::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  definitionNames.clear();
+  definitions.clear();
+  total = PhaseEntries();
+}
+
+static double toMilliseconds(Timings::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static double toSeconds(Timings::Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+void Timings::printTable(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  size_t nameWidth = 10;
+  size_t phaseWidth = 5;
+  for (auto const& name : definitionNames) {
+    nameWidth = std::max(nameWidth, name.size());
+  }
+  for (auto const& entry : total.entries) {
+    phaseWidth = std::max(phaseWidth, entry.first.size());
+  }
+  
+  auto flags = out.flags();
+  auto printRows = [&](std::string const& name, PhaseEntries const& phases) {
+    for (auto const& entry : phases.entries) {
+      out << std::left << std::setw(nameWidth) << name << "  "
+          << std::setw(phaseWidth) << entry.first << "  "
+          << std::right << std::setw(8) << entry.second.count << "  "
+          << std::setw(12) << std::fixed << std::setprecision(3)
+          << toMilliseconds(entry.second.duration) << '\n';
+    }
+  };
+  
+  out << std::left << std::setw(nameWidth) << "definition" << "  "
+      << std::setw(phaseWidth) << "phase" << "  "
+      << std::right << std::setw(8) << "count" << "  "
+      << std::setw(12) << "time (ms)" << '\n';
+  for (auto const& name : definitionNames) {
+    printRows(name, definitions.at(name));
+  }
+  printRows("total", total);
+  out.flush();
+  out.flags(flags);
+}
+
+static void printJSONString(std::ostream& out, llvm::StringRef string) {
+  out << '"';
+  for (char ch : string) {
+    if (ch == '"' || ch == '\\') out << '\\';
+    out << ch;
+  }
+  out << '"';
+}
+
+void Timings::printJSON(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  
+  auto flags = out.flags();
+  auto printPhases = [&](PhaseEntries const& phases) {
+    out << '{';
+    for (size_t i = 0; i < phases.entries.size(); ++i) {
+      auto const& entry = phases.entries[i];
+      if (i > 0) out << ", ";
+      printJSONString(out, entry.first);
+      out << ": {\"count\": " << entry.second.count << ", \"seconds\": "
+          << std::scientific << std::setprecision(6)
+          << toSeconds(entry.second.duration) << '}';
+    }
+    out << '}';
+  };
+  
+  out << "{\"definitions\": {";
+  for (size_t i = 0; i < definitionNames.size(); ++i) {
+    if (i > 0) out << ", ";
+    printJSONString(out, definitionNames[i]);
+    out << ": ";
+    printPhases(definitions.at(definitionNames[i]));
+  }
+  out << "}, \"total\": ";
+  printPhases(total);
+  out << '}' << std::endl;
+  out.flags(flags);
+}
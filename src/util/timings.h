@@ -0,0 +1,93 @@
+#ifndef EAX_TIMINGS_H
+#define EAX_TIMINGS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/ADT/StringRef.h>
+
+namespace eax {
+
+/// Collects the time spent in each compilation phase and optimization pass,
+/// per definition and in total. Can be used from any thread. Nothing is
+/// recorded while it's disabled, which is the default.
+class Timings {
+public:
+  using Clock = std::chrono::steady_clock;
+  
+  /// Returns the process's timings.
+  static Timings& get();
+  
+  bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+  void setEnabled(bool enabled) { this->enabled = enabled; }
+  
+  /// Adds the time spent in "phase" for the given definition.
+  void add(llvm::StringRef definition, llvm::StringRef phase,
+           Clock::duration duration);
+  
+  /// Forgets everything recorded so far.
+  void reset();
+  
+  /// Prints the recorded times as a table, with the phases of each
+  /// definition followed by the totals of all definitions.
+  void printTable(std::ostream& out) const;
+  
+  /// Prints the recorded times as a JSON object of the form
+  /// {"definitions": {name: {phase: {"count": n, "seconds": s}}}, "total": {phase: ...}}.
+  void printJSON(std::ostream& out) const;
+  
+private:
+  struct Entry {
+    uint64_t count = 0;
+    Clock::duration duration = Clock::duration::zero();
+  };
+  
+  /// The entries of each phase, in the order the phases were first seen.
+  struct PhaseEntries {
+    std::vector<std::pair<std::string, Entry>> entries;
+    Entry& operator[](llvm::StringRef phase);
+  };
+  
+  std::atomic<bool> enabled{false};
+  mutable std::mutex mutex;
+  std::vector<std::string> definitionNames; // In the order first seen.
+  std::unordered_map<std::string, PhaseEntries> definitions;
+  PhaseEntries total;
+};
+
+/// Adds the time between its construction and destruction to a phase of a
+/// definition, if the timings are enabled. The definition can be set later,
+/// e.g. once it has been parsed.
+class PhaseTimer {
+public:
+  PhaseTimer(llvm::StringRef phase, llvm::StringRef definition = "")
+    : phase(phase), definition(definition.str()),
+      enabled(Timings::get().isEnabled()) {
+    if (enabled) start = Timings::Clock::now();
+  }
+  
+  ~PhaseTimer() { stop(); }
+  
+  /// Records the time now rather than on destruction.
+  void stop() {
+    if (enabled) Timings::get().add(definition, phase, Timings::Clock::now() - start);
+    enabled = false;
+  }
+  
+  void setDefinition(llvm::StringRef definition) { this->definition = definition.str(); }
+  
+private:
+  llvm::StringRef phase;
+  std::string definition;
+  bool enabled;
+  Timings::Clock::time_point start;
+};
+
+}
+
+#endif